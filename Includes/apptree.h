@@ -9,21 +9,112 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
 
-#include "list.h"
+#include "apptree_io.h"
 
 
-#define TERMINAL_HEIGHT					24
-#define TERMINAL_WIDTH					80
-
 #define FRAME_HEIGHT					18
 #define FRAME_WIDTH						80
 
 #define MAX_TITLE_WIDTH					74
 #define MAX_INFO_WIDTH					78
 
+/** Set as 1 to build in lazy nodes. This costs a window of FRAME_HEIGHT
+ *	titles of MAX_TITLE_WIDTH characters.
+ */
+#ifndef APPTREE_LAZY_NODES
+#define APPTREE_LAZY_NODES				0
+#endif
+
+/** Set as 1 to pack the number of children of each node into the word
+ *	holding its mode and string lengths, and its position among its siblings
+ *	into 16 bits. The number of children of a node is then limited to
+ *	APPTREE_MAX_CHILDREN, and reading the packed fields costs a few extra
+ *	instructions.
+ */
+#ifndef APPTREE_COMPACT_NODES
+#define APPTREE_COMPACT_NODES			0
+#endif
+
+#if APPTREE_COMPACT_NODES
+#define APPTREE_MAX_CHILDREN			0xffff
+#else
+#define APPTREE_MAX_CHILDREN			INT_MAX
+#endif
+
+/** Size in bytes of the cache holding the formatted rows of recently shown
+ *	nodes, which is split evenly into APPTREE_ROW_CACHE_PAGES pages. Set as 0
+ *	to leave the cache out.
+ */
+#ifndef APPTREE_ROW_CACHE_SIZE
+#define APPTREE_ROW_CACHE_SIZE			0
+#endif
+
+/** Number of nodes whose rows are kept in the row cache */
+#ifndef APPTREE_ROW_CACHE_PAGES
+#define APPTREE_ROW_CACHE_PAGES			4
+#endif
+
+/** Number of 16 bit words in each page of the row cache */
+#define APPTREE_ROW_PAGE_WORDS			\
+	(APPTREE_ROW_CACHE_SIZE / APPTREE_ROW_CACHE_PAGES / sizeof(uint16_t))
+
+#if (APPTREE_ROW_CACHE_SIZE / APPTREE_ROW_CACHE_PAGES) > 65536
+#error "Each page of the row cache must fit within 64 KiB"
+#endif
+
+/** Set as 1 to build in type-ahead, which jumps to the first child whose
+ *	title starts with the characters typed. This costs an int per node for
+ *	the children sorted by title.
+ */
+#ifndef APPTREE_TYPE_AHEAD
+#define APPTREE_TYPE_AHEAD				0
+#endif
+
+/** Maximum number of characters typed ahead */
+#ifndef APPTREE_SEARCH_LENGTH
+#define APPTREE_SEARCH_LENGTH			16
+#endif
+
+/** Number of levels whose frame and select arrow are remembered on the way
+ *	down, so that "back" and "home" return to where they were left. Levels
+ *	below it are shown from the top again. Set as 0 to leave the path out.
+ */
+#ifndef APPTREE_PATH_DEPTH
+#define APPTREE_PATH_DEPTH				0
+#endif
+
+/** Set as 1 to build in the importing and exporting of tree images, through
+ *	which a subtree is stored in flash or mirrored to another device. An image
+ *	is imported into nodes in RAM rather than read in place.
+ */
+#ifndef APPTREE_IMAGE
+#define APPTREE_IMAGE					0
+#endif
+
+/** Size of the queue of messages through which other tasks change the
+ *	apptree, which must be a power of two. Set as 0 to leave the queue out.
+ */
+#ifndef APPTREE_MESSAGE_QUEUE_SIZE
+#define APPTREE_MESSAGE_QUEUE_SIZE		0
+#endif
+
+#if (APPTREE_MESSAGE_QUEUE_SIZE & (APPTREE_MESSAGE_QUEUE_SIZE - 1))
+#error "APPTREE_MESSAGE_QUEUE_SIZE must be a power of two"
+#endif
+
+#if (MAX_TITLE_WIDTH > 127) || (MAX_INFO_WIDTH > 127)
+#error "MAX_TITLE_WIDTH and MAX_INFO_WIDTH must fit the 7 bit lengths of a node"
+#endif
+
+/** Number of 32 bit words in the selection bitset of num_child children */
+#define APPTREE_SELECTION_WORDS(num_child)	(((num_child) + 31) / 32)
+
 
 struct apptree_node;
+struct apptree_tree;
 
 
 /** @enum apptree_mode
@@ -38,6 +129,92 @@ enum apptree_mode {
 	APPTREE_MODE_MULTI_SELECTION
 };
 
+/** @struct apptree_provider
+ *	@brief Provides the items of a lazy node on demand
+ */
+struct apptree_provider {
+	/** @brief Returns the number of items in the node.
+	 *	@param node The lazy node.
+	 */
+	int (*count)(struct apptree_node *node);
+	/** @brief Returns the title of an item.
+	 *	@param node The lazy node.
+	 *	@param index The position of the item.
+	 *
+	 *	The title is copied right away, so it only has to stay valid until the
+	 *	next call.
+	 */
+	const char *(*title)(struct apptree_node *node, int index);
+	/** @brief Optional function returning the info of an item.
+	 *	@param node The lazy node.
+	 *	@param index The position of the item.
+	 *
+	 *	The info of the lazy node itself is shown if this is NULL.
+	 */
+	const char *(*info)(struct apptree_node *node, int index);
+	/** @brief Optional function returning whether an item is selected.
+	 *	@param node The lazy node.
+	 *	@param index The position of the item.
+	 *
+	 *	Only used if the lazy node is not Simple. Items are shown as not
+	 *	selected if this is NULL.
+	 */
+	bool (*selected)(struct apptree_node *node, int index);
+	/** @brief Optional function called when an item is selected.
+	 *	@param node The lazy node.
+	 *	@param index The position of the item.
+	 *
+	 *	The items are counted and resolved again after this is called, so the
+	 *	provider may update its selections or items here.
+	 */
+	void (*function)(struct apptree_node *node, int index);
+};
+
+/** @struct apptree_state
+ *	@brief State of a node which changes while the apptree is running
+ *
+ *	The state is kept apart from the rest of the node so that constant nodes
+ *	can be placed in read-only memory.
+ */
+struct apptree_state {
+#if APPTREE_COMPACT_NODES
+	/** Position of the node among the children of its parent. Tracked once
+	 *	the tree is frozen.
+	 */
+	unsigned int child_index : 16;
+#else
+	/** Position of the node among the children of its parent. Tracked once
+	 *	the tree is frozen.
+	 */
+	unsigned int child_index : 31;
+#endif
+	/** Determines if this node is selected. For the children of a Multi
+	 *	Selection node, this is only the initial selection, as the parent
+	 *	holds the selection in its bitset once the tree is frozen.
+	 */
+	unsigned int selected : 1;
+};
+
+/** @struct apptree_parent_state
+ *	@brief State of a Single or Multi Selection node with children
+ *
+ *	Only these nodes track a selection, so their state is moved into one of
+ *	these records once the tree is frozen, and the other nodes keep no room
+ *	for it.
+ */
+struct apptree_parent_state {
+	/** State of the node itself */
+	struct apptree_state state;
+	/** Position of the selected child of a Single Selection node, or -1 if
+	 *	none of its children is selected
+	 */
+	int selected_child;
+	/** Selection bitset of the children of a Multi Selection node, with bit
+	 *	i % 32 of word i / 32 set if child i is selected
+	 */
+	uint32_t *selection;
+};
+
 /** @struct apptree_node
  *	@brief A single tree node
  */
@@ -49,28 +226,308 @@ struct apptree_node {
 	
 	/** Parent of the node */
 	struct apptree_node *parent;
+	/** Tree the node is attached to, or NULL for constant nodes and for
+	 *	removed nodes
+	 */
+	struct apptree_tree *tree;
 	
-	/** Mode of the node */
-	enum apptree_mode mode;
-	/** List head for inserting the node as a children of another node */
-	struct list_head list_child;
-	/** List head for inserting the node as a parent of another node */
-	struct list_head list_parent;
-	/** Number of children in this node */
-	int num_child;
+	/** Last child attached to this node, which heads the chain of children
+	 *	until the tree is indexed
+	 */
+	struct apptree_node *last_child;
+	/** Child of the parent attached right before this node */
+	struct apptree_node *prev_sibling;
+	/** Children of this node in order, indexed when the apptree is enabled */
+	struct apptree_node **children;
+#if APPTREE_LAZY_NODES
+	/** Provider of the items of a lazy node, or NULL for other nodes */
+	const struct apptree_provider *provider;
+#endif
 	
-	/** Determines if this node is selected */
-	bool selected;
-	/** Determines if this is an end node */
-	bool end;
+	/** State of the node, which is the state of its apptree_parent_state
+	 *	for Single and Multi Selection nodes with children once the tree is
+	 *	frozen
+	 */
+	struct apptree_state *state;
 	
 	/** Function called when the node is selected
 	 *	@param parent Parent of this node.
 	 *	@param child_idx The position of this node as a child to its parent.
 	 */
 	void (*function)(struct apptree_node *parent, int child_idx);
+	
+	/** Storage for the state of nodes created at runtime */
+	struct apptree_state state_storage;
+#if APPTREE_ROW_CACHE_SIZE
+	/** Incremented whenever the rows of the children change, which outdates
+	 *	the rows of this node in the row cache of every session
+	 */
+	unsigned int rows_version;
+#endif
+	
+#if APPTREE_COMPACT_NODES
+	/** Number of children in this node */
+	unsigned int num_child : 16;
+#else
+	/** Number of children in this node */
+	int num_child;
+#endif
+	/** Length of the title, or 0 if it has to be counted */
+	unsigned int title_len : 7;
+	/** Length of the info, or 0 if it has to be counted */
+	unsigned int info_len : 7;
+	/** Mode of the node, which is an enum apptree_mode */
+	unsigned int mode : 2;
+};
+
+/** @struct apptree_node_spec
+ *	@brief Describes a node of a subtree created by apptree_create_subtree
+ */
+struct apptree_node_spec {
+	/** Position of the parent in the specification, which must come before
+	 *	this entry, or -1 for the node the subtree is attached to
+	 */
+	int parent;
+	/** Title message of the node */
+	char *title;
+	/** Info message of the node */
+	char *info;
+	/** Mode of the node */
+	enum apptree_mode mode;
+	/** Determines if the node is initially selected */
+	bool selected;
+	/** Function to bind to the node */
+	void (*function)(struct apptree_node *parent, int child_idx);
+};
+
+#if APPTREE_IMAGE
+/** Magic number at the start of an image, which reads "ATRI" in memory */
+#define APPTREE_IMAGE_MAGIC				0x49525441u
+/** Version of the image format */
+#define APPTREE_IMAGE_VERSION			2
+/** Offset or position standing for no string or no parent in an image */
+#define APPTREE_IMAGE_NONE				0xffffffffu
+
+/** @struct apptree_image_header
+ *	@brief Header at the start of a tree image
+ *
+ *	An image is a flat, position independent copy of a subtree, which is laid
+ *	out as the header, the nodes, the selection bits and the string table in
+ *	this order. Offsets are counted in bytes from the start of the image. All
+ *	fields are in the byte order of the device, so the exporter and the
+ *	importer have to share it, as little endian hosts and targets do.
+ */
+struct apptree_image_header {
+	/** APPTREE_IMAGE_MAGIC */
+	uint32_t magic;
+	/** APPTREE_IMAGE_VERSION */
+	uint16_t version;
+	/** Size of each node, which is sizeof(struct apptree_image_node) */
+	uint16_t node_size;
+	/** Size of the whole image */
+	uint32_t size;
+	/** Number of nodes */
+	uint32_t num_nodes;
+	/** Offset of the nodes */
+	uint32_t nodes;
+	/** Offset of the selection bits, with bit i % 32 of word i / 32 set if
+	 *	node i is initially selected
+	 */
+	uint32_t selection;
+	/** Offset of the string table, which holds every distinct string once
+	 *	as an apptree_image_string
+	 */
+	uint32_t strings;
+	/** Size of the string table */
+	uint32_t strings_size;
+};
+
+/** @struct apptree_image_node
+ *	@brief A node of a tree image
+ *
+ *	Every node comes after its parent, and siblings come in the order they
+ *	are shown.
+ */
+struct apptree_image_node {
+	/** Position of the parent among the nodes, or APPTREE_IMAGE_NONE for the
+	 *	node the image is imported under
+	 */
+	uint32_t parent;
+	/** Offset of the entry of the title in the string table, or
+	 *	APPTREE_IMAGE_NONE
+	 */
+	uint32_t title;
+	/** Offset of the entry of the info in the string table, or
+	 *	APPTREE_IMAGE_NONE
+	 */
+	uint32_t info;
+	/** Position of the function in the function table plus 1, or 0 if the
+	 *	node has no function
+	 */
+	uint16_t function;
+	/** Mode of the node, which is an enum apptree_mode */
+	uint8_t mode;
+	/** Reserved, which is 0 */
+	uint8_t reserved;
 };
 
+/** @struct apptree_image_string
+ *	@brief An entry of the string table of a tree image
+ *
+ *	Titles are clipped to MAX_TITLE_WIDTH and infos to MAX_INFO_WIDTH
+ *	characters. Entries are aligned to 2 bytes, so each is padded to
+ *	sizeof(uint16_t) + APPTREE_IMAGE_STRING_SIZE(len) bytes.
+ */
+struct apptree_image_string {
+	/** Number of characters in the string */
+	uint16_t len;
+	/** Characters of the string, followed by a null character */
+	char text[];
+};
+
+/** Bytes taken by the characters of a string entry of len characters */
+#define APPTREE_IMAGE_STRING_SIZE(len)	(((len) + 2) & ~1u)
+#endif
+
+/** @brief Declares a constant node before it is defined
+ *	@param name Name of the node.
+ *
+ *	Nodes refer to both their parent and their children, so every constant
+ *	node has to be declared before any of them are defined.
+ */
+#define APPTREE_CONST_DECLARE(name)									\
+	extern const struct apptree_node name
+
+/** @brief Defines the children of a constant node
+ *	@param name Name of the parent node.
+ *	@param ... Addresses of the children in order.
+ */
+#define APPTREE_CONST_CHILDREN(name, ...)							\
+	static const struct apptree_node *const name##_children[] = {	\
+		__VA_ARGS__													\
+	}
+
+/** @brief Defines a constant node with children
+ *	@param name Name of the node. Its children must be defined beforehand
+ *	with APPTREE_CONST_CHILDREN.
+ *	@param parent_node Address of the parent, or NULL for the master.
+ *	@param node_title Title message of the node.
+ *	@param node_info Info message of the node.
+ *	@param node_mode Mode of the node.
+ *	@param node_function Function to bind to this node.
+ */
+#define APPTREE_CONST_NODE(name, parent_node, node_title, node_info,	\
+							node_mode, node_function)				\
+	static uint32_t name##_selection[APPTREE_SELECTION_WORDS(			\
+		sizeof(name##_children) / sizeof(name##_children[0]))];		\
+	static struct apptree_parent_state name##_state = {				\
+		.selection	= name##_selection								\
+	};																\
+	const struct apptree_node name = {								\
+		.title		= (node_title),									\
+		.info		= (node_info),									\
+		.parent		= (struct apptree_node *)(parent_node),			\
+		.mode		= (node_mode),									\
+		.num_child	= sizeof(name##_children) /						\
+						sizeof(name##_children[0]),					\
+		.children	= (struct apptree_node **)name##_children,		\
+		.state		= &name##_state.state,							\
+		.function	= (node_function)								\
+	}
+
+/** @brief Defines a constant node without children
+ *	@param name Name of the node.
+ *	@param parent_node Address of the parent.
+ *	@param node_title Title message of the node.
+ *	@param node_info Info message of the node.
+ *	@param node_selected Determines if the node is initially selected.
+ *	@param node_function Function to bind to this node.
+ */
+#define APPTREE_CONST_LEAF(name, parent_node, node_title, node_info,	\
+							node_selected, node_function)			\
+	static struct apptree_state name##_state = {					\
+		.selected	= (node_selected)								\
+	};																\
+	const struct apptree_node name = {								\
+		.title		= (node_title),									\
+		.info		= (node_info),									\
+		.parent		= (struct apptree_node *)(parent_node),			\
+		.mode		= APPTREE_MODE_SIMPLE,							\
+		.num_child	= 0,											\
+		.children	= NULL,											\
+		.state		= &name##_state,								\
+		.function	= (node_function)								\
+	}
+
+/** @struct apptree_pool
+ *	@brief Caller supplied storage for the nodes of a tree
+ */
+struct apptree_pool {
+	/** Storage for the nodes */
+	struct apptree_node *nodes;
+	/** Storage for the child index, with at least one slot per node */
+	struct apptree_node **index;
+	/** Storage for the selection bitsets of the Multi Selection nodes */
+	uint32_t *selection;
+	/** Storage for the states of the Single and Multi Selection nodes with
+	 *	children, with one slot per two nodes
+	 */
+	struct apptree_parent_state *parents;
+	/** Number of nodes in the pool */
+	int size;
+	/** Number of words in selection */
+	int selection_size;
+	/** Number of nodes handed out */
+	int used;
+#if APPTREE_TYPE_AHEAD
+	/** Storage for the children sorted by title, with one slot per node */
+	int *sorted;
+#endif
+};
+
+/** @brief Number of selection words needed by a pool of num_nodes nodes
+ *
+ *	Every Multi Selection node with children takes up at least two nodes and
+ *	rounds its bitset up to a whole word, which bounds the words needed by
+ *	any tree which fits into the pool.
+ */
+#define APPTREE_POOL_SELECTION_WORDS(num_nodes)						\
+	((num_nodes) / 2 + APPTREE_SELECTION_WORDS(num_nodes))
+
+/** @brief Number of parent states needed by a pool of num_nodes nodes
+ *
+ *	The children of Single and Multi Selection nodes are end nodes, so every
+ *	such node with children has at least one child of its own.
+ */
+#define APPTREE_POOL_PARENTS(num_nodes)		((num_nodes) / 2 + 1)
+
+#if APPTREE_TYPE_AHEAD
+#define APPTREE_POOL_SORTED(name, num_nodes)						\
+	static int name##_sorted[num_nodes];
+#define APPTREE_POOL_SORTED_INIT(name)		, name##_sorted
+#else
+#define APPTREE_POOL_SORTED(name, num_nodes)
+#define APPTREE_POOL_SORTED_INIT(name)
+#endif
+
+/** @brief Declares a static pool
+ *	@param name Name of the pool.
+ *	@param num_nodes Maximum number of nodes in the tree, including the master.
+ */
+#define APPTREE_POOL(name, num_nodes)								\
+	static struct apptree_node name##_nodes[num_nodes];				\
+	static struct apptree_node *name##_index[num_nodes];			\
+	static uint32_t name##_selection[								\
+		APPTREE_POOL_SELECTION_WORDS(num_nodes)];					\
+	static struct apptree_parent_state name##_parents[				\
+		APPTREE_POOL_PARENTS(num_nodes)];							\
+	APPTREE_POOL_SORTED(name, num_nodes)							\
+	static struct apptree_pool name = {								\
+		name##_nodes, name##_index, name##_selection, name##_parents,	\
+		(num_nodes), APPTREE_POOL_SELECTION_WORDS(num_nodes), 0		\
+		APPTREE_POOL_SORTED_INIT(name)								\
+	}
+
 /** @struct apptree_keybindings
  *	@brief Structure for holding key binding information
  */
@@ -80,19 +537,165 @@ struct apptree_keybindings {
 	char select;
 	char back;
 	char home;
+	/** Key moving the select arrow up by a frame, or 0 if unbound */
+	char page_up;
+	/** Key moving the select arrow down by a frame, or 0 if unbound */
+	char page_down;
 };
 
-/** @struct apptree_control
- *	@brief Keeps track of the apptree
+/** @enum apptree_action
+ *	@brief Defines the actions which inputs are decoded into.
  */
-struct apptree_control {
+enum apptree_action {
+	/** Input bound to no action */
+	APPTREE_ACTION_NONE,
+	/** Moves the select arrow up */
+	APPTREE_ACTION_UP,
+	/** Moves the select arrow down */
+	APPTREE_ACTION_DOWN,
+	/** Selects the child under the select arrow */
+	APPTREE_ACTION_SELECT,
+	/** Goes back to the parent */
+	APPTREE_ACTION_BACK,
+	/** Goes back to the master */
+	APPTREE_ACTION_HOME,
+	/** Moves the select arrow up by a frame */
+	APPTREE_ACTION_PAGE_UP,
+	/** Moves the select arrow down by a frame */
+	APPTREE_ACTION_PAGE_DOWN,
+	/** Input is part of an escape sequence, which has no action of its own */
+	APPTREE_ACTION_IGNORE
+};
+
+/** @enum apptree_message_type
+ *	@brief Defines the changes which can be posted as messages.
+ */
+enum apptree_message_type {
+	/** Sets whether the node is selected */
+	APPTREE_MESSAGE_SELECT,
+	/** Replaces the title of the node */
+	APPTREE_MESSAGE_TITLE,
+	/** Replaces the info of the node */
+	APPTREE_MESSAGE_INFO,
+	/** Refreshes the node, as with apptree_refresh_node */
+	APPTREE_MESSAGE_REFRESH
+};
+
+/** @struct apptree_message
+ *	@brief A change to a node, posted from another task
+ */
+struct apptree_message {
+	/** Type of the change */
+	enum apptree_message_type type;
+	/** Node to be changed */
+	struct apptree_node *node;
+	/** New value, depending on the type */
+	union {
+		/** Selected state for APPTREE_MESSAGE_SELECT */
+		bool selected;
+		/** New string for APPTREE_MESSAGE_TITLE and APPTREE_MESSAGE_INFO,
+		 *	which must stay valid while it is shown
+		 */
+		char *text;
+	} value;
+};
+
+#if APPTREE_ROW_CACHE_SIZE
+/** @struct apptree_row_page
+ *	@brief Formatted rows of the children of a node, kept in the row cache
+ *
+ *	Each row is laid out as it is printed, with the 4 characters of the select
+ *	arrow first, followed by the 4 characters of the selected marker if the
+ *	node is not Simple. Only these are filled in when the row is printed.
+ */
+struct apptree_row_page {
+	/** Node whose children are formatted, or NULL if the page is free */
+	const struct apptree_node *node;
+	/** Generation of the tree in which the rows were formatted */
+	unsigned int generation;
+	/** Version of the rows of the node when they were formatted */
+	unsigned int version;
+	/** Value of the use clock when the page was last shown */
+	unsigned int last_used;
+	/** Offsets of the rows into the characters which follow the offsets,
+	 *	with one more offset marking the end of the last row
+	 */
+	uint16_t data[APPTREE_ROW_PAGE_WORDS];
+};
+#endif
+
+#if APPTREE_PATH_DEPTH
+/** @struct apptree_crumb
+ *	@brief View of a level left by selecting one of its children
+ */
+struct apptree_crumb {
+	/** Node shown on the level */
+	const struct apptree_node *node;
+	/** Position of the frame when the level was left */
+	int frame_pos;
+	/** Position of the select arrow when the level was left */
+	int select_pos;
+};
+#endif
+
+/** @struct apptree_tree
+ *	@brief Keeps track of a tree, which may be shared by several sessions
+ */
+struct apptree_tree {
 	/** Handle to the master node */
 	struct apptree_node *master;
+	
+	/** Pool the nodes are allocated from, or NULL for the heap */
+	struct apptree_pool *pool;
+	/** Storage for the child index of every node in the tree */
+	struct apptree_node **index;
+	/** Storage for the selection bitsets of the Multi Selection nodes */
+	uint32_t *selection;
+	/** Storage for the states of the Single and Multi Selection nodes with
+	 *	children
+	 */
+	struct apptree_parent_state *parents;
+#if APPTREE_TYPE_AHEAD
+	/** Positions of the children of every node sorted by title, laid out
+	 *	like the child index, or NULL if the tree has no child index
+	 */
+	int *sorted;
+#endif
+	/** Number of nodes in the tree, including the master */
+	int num_nodes;
+	/** Number of sessions showing the tree */
+	int num_sessions;
+	
+	/** Set as true once the tree is indexed or constant and can no longer be
+	 *	changed.
+	 */
+	bool frozen;
+	
+#if APPTREE_ROW_CACHE_SIZE
+	/** Incremented whenever a constant node is refreshed or nodes are added
+	 *	or removed in an update, which outdates every row in the row cache of
+	 *	every session
+	 */
+	unsigned int generation;
+#endif
+	
+#if APPTREE_STATS
+	/** Number of heap allocations made for the tree */
+	uint32_t allocations;
+#endif
+};
+
+/** @struct apptree_control
+ *	@brief Keeps track of an apptree session driving a single display
+ */
+struct apptree_control {
+	/** Tree shown by this session */
+	struct apptree_tree *tree;
 	/** Handle to the current parent */
 	struct apptree_node *current;
 	
-	/** Titles of all children for current master */
-	char **picture;
+	/** Children of the current node, viewed through its child index */
+	struct apptree_node **picture;
 	/** Height of the picture. */
 	int picture_height;
 	
@@ -101,32 +704,217 @@ struct apptree_control {
 	/** Position of the select arrow in the picture. */
 	int select_pos;
 	
+#if APPTREE_PATH_DEPTH
+	/** Views of the levels above the current node, from the master down */
+	struct apptree_crumb path[APPTREE_PATH_DEPTH];
+	/** Depth of the current node, of which only the first APPTREE_PATH_DEPTH
+	 *	levels are kept in path
+	 */
+	int path_len;
+#endif
+	
+#if APPTREE_ROW_CACHE_SIZE
+	/** Pages of the row cache */
+	struct apptree_row_page row_cache[APPTREE_ROW_CACHE_PAGES];
+	/** Clock counting the uses of the pages */
+	unsigned int row_clock;
+	/** Last node whose rows were found not to fit into a page */
+	const struct apptree_node *row_rejected;
+	/** Generation of the tree when row_rejected was found not to fit */
+	unsigned int row_rejected_generation;
+	/** Version of the rows of row_rejected when it was found not to fit */
+	unsigned int row_rejected_version;
+#endif
+	
+#if APPTREE_LAZY_NODES
+	/** Titles of the items in the frame when the current node is lazy */
+	char window[FRAME_HEIGHT][MAX_TITLE_WIDTH + 1];
+	/** Value of frame_pos when the window was filled, or -1 if empty */
+	int window_pos;
+#endif
+	
 	/** Set as true when the enable function is called. */
 	bool enabled;
+	/** Set as true when an input requires the menu to be printed. */
+	bool redraw;
+	
+	/** Number of updates begun and not yet committed. */
+	int update_depth;
+	/** Set as true once nodes are added or removed in the current update. */
+	bool update_structure;
+	/** Nodes removed in the current update, chained through prev_sibling. */
+	struct apptree_node *removed;
+	
+	/** Set as true when the menu is rendered by apptree_render_step. */
+	bool incremental;
+	/** Next row to be rendered, or TERMINAL_HEIGHT if the menu is done. */
+	int render_row;
+	
+	/** Minimum number of ticks between two menus, or 0 if not limited. */
+	int frame_interval;
+	/** Number of ticks since the last menu, up to frame_interval. */
+	int frame_ticks;
+	
+#if APPTREE_DIFF_RENDER
+	/** Current node when the last menu was printed */
+	struct apptree_node *shown_node;
+	/** Value of frame_pos when the last menu was printed */
+	int shown_frame_pos;
+#endif
 	
 	/** Input key bindings. */
 	struct apptree_keybindings *keys;
+	/** Action of every input byte, built from keys by apptree_enable */
+	unsigned char key_map[256];
+	/** State of the escape sequence decoder */
+	unsigned char input_state;
+	/** Numeric parameter of the escape sequence being decoded */
+	unsigned char input_param;
 	
-
+#if APPTREE_TYPE_AHEAD
+	/** Characters typed ahead since the last key binding */
+	char search[APPTREE_SEARCH_LENGTH];
+	/** Number of characters in search */
+	int search_len;
+#endif
+	
+#if APPTREE_STATS
+	/** Optional function timing the handling of inputs */
+	uint32_t (*timestamp)(void);
+#endif
+	
+#if APPTREE_MESSAGE_QUEUE_SIZE
+	/** Queue of messages which have been posted but not applied */
+	struct apptree_message messages[APPTREE_MESSAGE_QUEUE_SIZE];
+	/** Number of messages ever applied, only written by the session */
+	volatile unsigned int message_head;
+	/** Number of messages ever posted, only written under the lock */
+	volatile unsigned int message_tail;
+	/** Optional functions serializing the tasks which post messages */
+	void (*lock)(void);
+	void (*unlock)(void);
+#endif
+	
+	/** Storage for the tree when it is created by this session */
+	struct apptree_tree tree_storage;
+	/** Input and output of this session */
+	struct apptree_io_control io;
 };
 
 
-int apptree_create_node(struct apptree_node **new_node,
+int apptree_create_node(struct apptree_control *control,
+		struct apptree_node **new_node,
 		struct apptree_node *parent,
 		char *title,
 		char *info,
 		enum apptree_mode mode,
 		bool selected,
 		void (*function)(struct apptree_node *parent, int child_idx));
+int apptree_create_lazy_node(struct apptree_control *control,
+		struct apptree_node **new_node,
+		struct apptree_node *parent,
+		char *title,
+		char *info,
+		enum apptree_mode mode,
+		const struct apptree_provider *provider,
+		void (*function)(struct apptree_node *parent, int child_idx));
+int apptree_create_subtree(struct apptree_control *control,
+							struct apptree_node **nodes,
+							struct apptree_node *parent,
+							const struct apptree_node_spec *spec,
+							int count);
 
-int apptree_init(struct apptree_node **master,
+int apptree_init(struct apptree_control *control,
+					struct apptree_node **master,
 					char *master_title,
 					enum apptree_mode master_mode,
 					struct apptree_keybindings *key,
 					int (*read_input)(char *input),
 					void (*write_output)(char output));
+int apptree_init_pool(struct apptree_control *control,
+						struct apptree_node **master,
+						char *master_title,
+						enum apptree_mode master_mode,
+						struct apptree_keybindings *key,
+						int (*read_input)(char *input),
+						void (*write_output)(char output),
+						struct apptree_pool *pool);
+int apptree_init_const(struct apptree_control *control,
+						const struct apptree_node *master,
+						struct apptree_keybindings *key,
+						int (*read_input)(char *input),
+						void (*write_output)(char output));
+int apptree_init_shared(struct apptree_control *control,
+						struct apptree_control *owner,
+						struct apptree_keybindings *key,
+						int (*read_input)(char *input),
+						void (*write_output)(char output));
+
+int apptree_set_write_block(struct apptree_control *control,
+							void (*write_block)(const char *buf, size_t len));
+int apptree_set_write_vector(struct apptree_control *control,
+								void (*write_vector)(
+								const struct apptree_iovec *iov, int count));
+int apptree_set_diff_render(struct apptree_control *control,
+							bool enable, void (*goto_line)(int line));
+int apptree_set_display(struct apptree_control *control,
+						const struct apptree_display *display);
+int apptree_set_framebuffer(struct apptree_control *control,
+							char *ram, int width, int height,
+							void (*refresh)(int first_row, int last_row));
+int apptree_set_scroll_region(struct apptree_control *control, bool enable);
+int apptree_set_incremental_render(struct apptree_control *control,
+									bool enable);
+int apptree_set_frame_limit(struct apptree_control *control, int interval);
+
+int apptree_enable(struct apptree_control *control);
+int apptree_refresh_node(struct apptree_control *control,
+							struct apptree_node *node);
+int apptree_get_selected(const struct apptree_node *parent);
+
+bool apptree_is_selected(const struct apptree_node *parent, int child_index);
+int apptree_get_selection_mask(const struct apptree_node *parent,
+								uint32_t *mask, int words);
+int apptree_set_selection_mask(struct apptree_node *parent,
+								const uint32_t *mask, int words);
+int apptree_select_all(struct apptree_node *parent);
+int apptree_clear_all(struct apptree_node *parent);
+int apptree_begin_update(struct apptree_control *control);
+int apptree_update_node(struct apptree_control *control,
+						const struct apptree_message *change);
+int apptree_remove_node(struct apptree_control *control,
+						struct apptree_node *node);
+int apptree_commit_update(struct apptree_control *control);
+int apptree_handle_input(struct apptree_control *control);
+int apptree_render_step(struct apptree_control *control, int budget);
+int apptree_tick(struct apptree_control *control);
+
+int apptree_set_lock(struct apptree_control *control,
+						void (*lock)(void), void (*unlock)(void));
+int apptree_post_message(struct apptree_control *control,
+							const struct apptree_message *message);
+int apptree_post_input(struct apptree_control *control, char input);
+
+#if APPTREE_IMAGE
+int apptree_import_image(struct apptree_control *control,
+		struct apptree_node **nodes,
+		struct apptree_node *parent,
+		const void *image,
+		size_t size,
+		void (*const functions[])(struct apptree_node *parent, int child_idx),
+		int num_functions);
+int apptree_export_image(struct apptree_control *control,
+		const struct apptree_node *parent,
+		void *buffer,
+		size_t *size,
+		void (*const functions[])(struct apptree_node *parent, int child_idx),
+		int num_functions);
+#endif
 
-int apptree_enable(void);
-int apptree_handle_input(void);
+int apptree_set_timestamp(struct apptree_control *control,
+							uint32_t (*timestamp)(void));
+int apptree_get_stats(struct apptree_control *control,
+						struct apptree_stats *stats);
+int apptree_reset_stats(struct apptree_control *control);
 
 #endif	/* APPTREE_H */
@@ -0,0 +1,103 @@
+/** @file apptree_cycles.h
+ *  @brief Cycle counter for measuring the apptree on its target
+ *  @author Dennis Law
+ *  @date October 2026
+ *
+ *	Wraps the DWT cycle counter of Cortex-M3 and later cores, so that the cost
+ *	of apptree_handle_input and of drawing a menu can be measured on the core
+ *	it runs on. A typical measurement binds apptree_null_display, to leave out
+ *	the cost of the output, and feeds a scripted series of keys through the
+ *	read_input function:
+ *
+ *		apptree_cycles_start();
+ *		start = apptree_cycles_read();
+ *		apptree_handle_input(&control);
+ *		cycles = apptree_cycles_elapsed(start);
+ *
+ *	On other targets, APPTREE_CYCLES_READ may be defined as an expression
+ *	reading some other free running counter. The benchmarks in bench/bench.c
+ *	time their scenarios this way.
+ */
+
+#ifndef APPTREE_CYCLES_H
+#define APPTREE_CYCLES_H
+
+#include <stdint.h>
+
+
+/** Set as 1 to count with the DWT cycle counter. Detected from the compiler
+ *	by default.
+ */
+#ifndef APPTREE_CYCLES_DWT
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__) || \
+	defined(__ARM_ARCH_8M_MAIN__) || defined(__ARM_ARCH_8_1M_MAIN__)
+#define APPTREE_CYCLES_DWT				1
+#else
+#define APPTREE_CYCLES_DWT				0
+#endif
+#endif
+
+#if APPTREE_CYCLES_DWT
+/** Debug Exception and Monitor Control Register */
+#define APPTREE_DEMCR					(*(volatile uint32_t *)0xE000EDFCu)
+/** DWT Control Register */
+#define APPTREE_DWT_CTRL				(*(volatile uint32_t *)0xE0001000u)
+/** DWT Cycle Count Register */
+#define APPTREE_DWT_CYCCNT				(*(volatile uint32_t *)0xE0001004u)
+/** DWT Lock Access Register, which has to be unlocked on Cortex-M7 */
+#define APPTREE_DWT_LAR					(*(volatile uint32_t *)0xE0001FB0u)
+
+#define APPTREE_DEMCR_TRCENA			(1u << 24)
+#define APPTREE_DWT_CTRL_CYCCNTENA		(1u << 0)
+#define APPTREE_DWT_CTRL_NOCYCCNT		(1u << 25)
+#define APPTREE_DWT_LAR_KEY				0xC5ACCE55u
+#endif
+
+
+/** @brief Starts the cycle counter from 0
+ *	@returns 0 if successful and -1 if there is no cycle counter.
+ */
+static inline int apptree_cycles_start(void)
+{
+#if APPTREE_CYCLES_DWT
+	APPTREE_DEMCR |= APPTREE_DEMCR_TRCENA;
+	if (APPTREE_DWT_CTRL & APPTREE_DWT_CTRL_NOCYCCNT)
+		return -1;
+
+	APPTREE_DWT_LAR	   = APPTREE_DWT_LAR_KEY;
+	APPTREE_DWT_CYCCNT = 0;
+	APPTREE_DWT_CTRL  |= APPTREE_DWT_CTRL_CYCCNTENA;
+	return 0;
+#elif defined(APPTREE_CYCLES_READ)
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+/** @brief Reads the cycle counter
+ *	@returns The number of cycles counted, which wraps around at 32 bits, or
+ *	0 if there is no cycle counter.
+ */
+static inline uint32_t apptree_cycles_read(void)
+{
+#if APPTREE_CYCLES_DWT
+	return APPTREE_DWT_CYCCNT;
+#elif defined(APPTREE_CYCLES_READ)
+	return (uint32_t)(APPTREE_CYCLES_READ);
+#else
+	return 0;
+#endif
+}
+
+/** @brief Gets the number of cycles elapsed since a reading
+ *	@param start An earlier reading of apptree_cycles_read.
+ *	@returns The number of cycles elapsed, which is correct across a single
+ *	wrap around of the counter.
+ */
+static inline uint32_t apptree_cycles_elapsed(uint32_t start)
+{
+	return apptree_cycles_read() - start;
+}
+
+#endif	/* APPTREE_CYCLES_H */
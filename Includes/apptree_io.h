@@ -8,8 +8,161 @@
 #ifndef APPTREE_IO_H
 #define APPTREE_IO_H
 
-#include "apptree.h"
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
 
+
+#define TERMINAL_HEIGHT					24
+#define TERMINAL_WIDTH					80
+
+/** Size of the staging buffer used when a block writer is binded or output is
+ *	deferred. It should hold at least one row of the menu.
+ */
+#ifndef APPTREE_TX_BUFFER_SIZE
+#define APPTREE_TX_BUFFER_SIZE			128
+#endif
+
+/** Size of a buffer which holds any unsigned int in any supported base */
+#define APPTREE_NUMBER_SIZE				(sizeof(unsigned int) * 8 / 3 + 1)
+
+/** Size of the ring buffer holding pending inputs */
+#ifndef APPTREE_RX_BUFFER_SIZE
+#define APPTREE_RX_BUFFER_SIZE			16
+#endif
+
+/** Set as 1 to build in the diff render mode. This costs a shadow copy of the
+ *	terminal of TERMINAL_HEIGHT x TERMINAL_WIDTH characters.
+ */
+#ifndef APPTREE_DIFF_RENDER
+#define APPTREE_DIFF_RENDER				0
+#endif
+
+/** Size of the lock-free queue through which inputs are posted from another
+ *	task or an interrupt, which must be a power of two. Set as 0 to leave the
+ *	queue out.
+ */
+#ifndef APPTREE_INPUT_QUEUE_SIZE
+#define APPTREE_INPUT_QUEUE_SIZE		0
+#endif
+
+/** Set as 1 to build in the counters read with apptree_get_stats */
+#ifndef APPTREE_STATS
+#define APPTREE_STATS					0
+#endif
+
+/** Number of buckets in the histogram of the time taken to handle inputs */
+#ifndef APPTREE_STATS_BUCKETS
+#define APPTREE_STATS_BUCKETS			16
+#endif
+
+/** Orders the accesses to a lock-free queue. The default only stops the
+ *	compiler from reordering them, which is enough on a single core. Override
+ *	it with a hardware barrier, such as __DMB() on Cortex-M, when the producer
+ *	and consumer run on different cores.
+ */
+#ifndef APPTREE_MEMORY_BARRIER
+#if defined(__GNUC__)
+#define APPTREE_MEMORY_BARRIER()		__asm__ __volatile__("" ::: "memory")
+#else
+#define APPTREE_MEMORY_BARRIER()		do { } while (0)
+#endif
+#endif
+
+/** Adds n to a counter of the stats of an io control */
+#if APPTREE_STATS
+#define APPTREE_STATS_ADD(control, counter, n)	\
+	((control)->stats.counter += (n))
+#else
+#define APPTREE_STATS_ADD(control, counter, n)	((void)0)
+#endif
+
+#if (APPTREE_INPUT_QUEUE_SIZE & (APPTREE_INPUT_QUEUE_SIZE - 1))
+#error "APPTREE_INPUT_QUEUE_SIZE must be a power of two"
+#endif
+
+
+/** @struct apptree_iovec
+ *	@brief A segment of output for gather writes
+ */
+struct apptree_iovec {
+	/** Start of the segment */
+	const char *base;
+	/** Number of characters in the segment */
+	size_t len;
+};
+
+/** @struct apptree_stats
+ *	@brief Counts the work done by an apptree session
+ */
+struct apptree_stats {
+	/** Number of key inputs handled */
+	uint32_t inputs;
+	/** Number of posted messages applied */
+	uint32_t messages;
+	/** Number of menus in which every row was drawn */
+	uint32_t full_redraws;
+	/** Number of menus in which unchanged rows were left alone */
+	uint32_t partial_redraws;
+	/** Number of rows drawn */
+	uint32_t rows_drawn;
+	/** Number of unchanged rows left alone */
+	uint32_t rows_skipped;
+	/** Number of times the frame was scrolled on the terminal */
+	uint32_t scrolls;
+	/** Number of characters handed to the output functions */
+	uint32_t bytes;
+	/** Number of calls to the output functions */
+	uint32_t writes;
+	/** Number of times deferred output did not fit into the tx buffer and
+	 *	was written right away
+	 */
+	uint32_t overflows;
+	/** Number of items resolved from the providers of lazy nodes */
+	uint32_t lazy_resolves;
+	/** Number of heap allocations made for the tree */
+	uint32_t allocations;
+	/** Histogram of the time taken by apptree_handle_input, in units of the
+	 *	timestamp function. Bucket 0 counts times of 0, bucket i counts times
+	 *	from 2^(i-1) up to 2^i - 1 and the last bucket counts all longer times.
+	 */
+	uint32_t input_time[APPTREE_STATS_BUCKETS];
+};
+
+struct apptree_io_control;
+
+/** @struct apptree_display
+ *	@brief A display backend through which the menu is drawn
+ *
+ *	The menu is drawn one row at a time, starting with begin_row and ending
+ *	with end_row, and pushed to the display with flush once it is complete.
+ */
+struct apptree_display {
+	/** @brief Moves the cursor to the start of a row.
+	 *	@param control The io control.
+	 *	@param row The row, counted from 0 at the top of the display.
+	 */
+	void (*begin_row)(struct apptree_io_control *control, int row);
+	/** @brief Draws a list of segments at the cursor.
+	 *	@param control The io control.
+	 *	@param iov The segments to be drawn in order.
+	 *	@param count The number of segments in iov.
+	 */
+	void (*draw)(struct apptree_io_control *control,
+					const struct apptree_iovec *iov, int count);
+	/** @brief Ends the current row, clearing the rest of it.
+	 *	@param control The io control.
+	 */
+	void (*end_row)(struct apptree_io_control *control);
+	/** @brief Pushes the drawn menu to the display.
+	 *	@param control The io control.
+	 */
+	void (*flush)(struct apptree_io_control *control);
+};
+
+/** @struct apptree_io_control
+ *	@brief Keeps track of the input and output of a single display
+ */
 struct apptree_io_control {
 	/** @brief Non-blocking function for reading a single input.
 		@param input The input character read.
@@ -21,13 +174,165 @@ struct apptree_io_control {
 	 *	@param output The character to be written.
 	 */
 	void (*write_output)(char output);
+	/** @brief Optional blocking function for writing a block of outputs.
+	 *	@param buf The characters to be written.
+	 *	@param len The number of characters in buf.
+	 *
+	 *	When binded, outputs are staged in tx_buffer and handed over in bulk
+	 *	instead of one character at a time through write_output.
+	 */
+	void (*write_block)(const char *buf, size_t len);
+	/** @brief Optional blocking function for writing a list of segments.
+	 *	@param iov The segments to be written in order.
+	 *	@param count The number of segments in iov.
+	 *
+	 *	When binded, outputs which are made of a few known segments, such as
+	 *	the rows of the frame, are handed over in a single call.
+	 */
+	void (*write_vector)(const struct apptree_iovec *iov, int count);
+	
+	/** Display backend through which the menu is drawn */
+	const struct apptree_display *display;
+	
+	/** Ring buffer of inputs which have been read but not handled */
+	char rx_buffer[APPTREE_RX_BUFFER_SIZE];
+	/** Position of the oldest input in rx_buffer */
+	int rx_head;
+	/** Number of inputs held in rx_buffer */
+	int rx_count;
+	
+#if APPTREE_INPUT_QUEUE_SIZE
+	/** Lock-free queue of inputs posted by a single producer */
+	char input_queue[APPTREE_INPUT_QUEUE_SIZE];
+	/** Number of inputs ever taken from input_queue, only written by the
+	 *	consumer
+	 */
+	volatile unsigned int input_head;
+	/** Number of inputs ever posted to input_queue, only written by the
+	 *	producer
+	 */
+	volatile unsigned int input_tail;
+#endif
+	
+	/** Staging buffer for write_block */
+	char tx_buffer[APPTREE_TX_BUFFER_SIZE];
+	/** Number of characters held in tx_buffer */
+	size_t tx_len;
+	/** Number of characters in tx_buffer which have already been written */
+	size_t tx_pos;
+	/** Set as true when outputs are held until drained */
+	bool deferred;
+	
+	/** Display RAM of the framebuffer backend, holding fb_height rows of
+	 *	fb_width characters
+	 */
+	char *fb_ram;
+	/** Number of characters in each row of fb_ram */
+	int fb_width;
+	/** Number of rows in fb_ram */
+	int fb_height;
+	/** Row of the framebuffer cursor */
+	int fb_row;
+	/** Column of the framebuffer cursor */
+	int fb_column;
+	/** Set as true if the row at the framebuffer cursor has changed */
+	bool fb_row_dirty;
+	/** First and last rows of fb_ram changed since the last flush, with
+	 *	fb_first_dirty greater than fb_last_dirty if none has changed
+	 */
+	int fb_first_dirty;
+	int fb_last_dirty;
+	/** @brief Optional function for pushing changed rows to the display.
+	 *	@param first_row The first row which has changed.
+	 *	@param last_row The last row which has changed.
+	 */
+	void (*fb_refresh)(int first_row, int last_row);
+	
+#if APPTREE_STATS
+	/** Counters of the session */
+	struct apptree_stats stats;
+	/** Value of stats.rows_skipped when the last menu was flushed */
+	uint32_t stats_skipped;
+#endif
+	
+#if APPTREE_DIFF_RENDER
+	/** Set as true when only changed lines should be written */
+	bool diff_render;
+	/** @brief Optional function for moving the cursor to the start of a line.
+	 *	@param line The line to move to, counted from 0 at the top.
+	 */
+	void (*goto_line)(int line);
+	/** Set as true to shift the lines of a scrolled region on the terminal
+	 *	instead of writing them again
+	 */
+	bool scroll_region;
+	
+	/** Characters of each line as last written to the output */
+	char shadow[TERMINAL_HEIGHT][TERMINAL_WIDTH];
+	/** Length of each line in shadow */
+	unsigned char shadow_len[TERMINAL_HEIGHT];
+	/** Set as false when the output no longer matches the shadow */
+	bool shadow_valid;
+	
+	/** Set as true while a line is being captured into the shadow */
+	bool capture;
+	/** Line being captured */
+	int line;
+	/** Number of characters captured so far */
+	int line_len;
+	/** First column of the captured line which differs from the shadow */
+	int line_first;
+	/** Column following the last one which differs from the shadow */
+	int line_last;
+#endif
 };
 
 
-void apptree_io_init(int (*read_input)(char *input),
+extern const struct apptree_display apptree_terminal_display;
+extern const struct apptree_display apptree_framebuffer_display;
+extern const struct apptree_display apptree_null_display;
+
+void apptree_io_init(struct apptree_io_control *control,
+						int (*read_input)(char *input),
 						void (*write_output)(char output));
+void apptree_io_set_write_block(struct apptree_io_control *control,
+								void (*write_block)(const char *buf,
+													size_t len));
+void apptree_io_set_write_vector(struct apptree_io_control *control,
+									void (*write_vector)(
+								const struct apptree_iovec *iov, int count));
+void apptree_io_set_diff_render(struct apptree_io_control *control,
+								bool enable, void (*goto_line)(int line));
+void apptree_io_set_scroll_region(struct apptree_io_control *control,
+									bool enable);
+void apptree_io_set_deferred(struct apptree_io_control *control,
+								bool deferred);
+void apptree_io_set_display(struct apptree_io_control *control,
+							const struct apptree_display *display);
+void apptree_io_set_framebuffer(struct apptree_io_control *control,
+								char *ram, int width, int height,
+								void (*refresh)(int first_row,
+												int last_row));
+
+void apptree_io_begin_line(struct apptree_io_control *control, int line);
+void apptree_io_end_line(struct apptree_io_control *control);
+void apptree_io_scroll(struct apptree_io_control *control,
+						int top, int height, int lines);
 
-void apptree_print(char *format, ...);
-int apptree_read(char *input);
+void apptree_putc(struct apptree_io_control *control, char c);
+void apptree_puts(struct apptree_io_control *control, char *s);
+void apptree_putn(struct apptree_io_control *control,
+					const char *s, size_t len);
+void apptree_putv(struct apptree_io_control *control,
+					const struct apptree_iovec *iov, int count);
+void apptree_flush(struct apptree_io_control *control);
+void apptree_io_flush_display(struct apptree_io_control *control);
+int apptree_io_drain(struct apptree_io_control *control, int budget);
+bool apptree_io_pending(struct apptree_io_control *control);
+int apptree_format_dec(unsigned int num, int width, char *buff);
+void apptree_print(struct apptree_io_control *control, char *format, ...);
+int apptree_io_poll(struct apptree_io_control *control);
+int apptree_io_post_input(struct apptree_io_control *control, char input);
+int apptree_read(struct apptree_io_control *control, char *input);
 
 #endif	/* APPTREE_IO_H */
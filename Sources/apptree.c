@@ -5,43 +5,186 @@
  *  @date April 2016
  */
 
+#include <string.h>
 #include "apptree_io.h"
 #include "apptree.h"
 
 
-static int apptree_bind_keys(struct apptree_keybindings *key);
-static int apptree_create_master(struct apptree_node **master,
+/* Rows of the menu, counted from the top of the terminal */
+#define ROW_TITLE						1
+#define ROW_FRAME						3
+#define ROW_INFO						(ROW_FRAME + FRAME_HEIGHT + 1)
+#define ROW_KEYBINDINGS					(ROW_INFO + 1)
+
+
+static int apptree_bind_keys(struct apptree_control *control,
+								struct apptree_keybindings *key);
+static struct apptree_node *apptree_alloc_node(struct apptree_tree *tree);
+static int apptree_create_master(struct apptree_tree *tree,
+									struct apptree_node **master,
 									char *title,
 									enum apptree_mode mode);
+static void apptree_init_session(struct apptree_control *control,
+									struct apptree_tree *tree,
+									int (*read_input)(char *input),
+									void (*write_output)(char output));
 									
-static void apptree_populate_picture(void);
-static int apptree_resize_picture(void);
-static void apptree_print_keybindings(void);
-static void apptree_print_info(void);
-static void apptree_print_frame(void);
-static void apptree_print_title(void);
-static void apptree_print_blank(void);
-static void apptree_print_select(int index);
-static void apptree_print_selected(struct apptree_node *parent,
-									int child_index);
-static void apptree_print_menu(void);
+static int apptree_count_children(struct apptree_node *node);
+static void apptree_populate_picture(struct apptree_control *control);
+static void apptree_refresh_picture(struct apptree_control *control);
+#if APPTREE_LAZY_NODES
+static void apptree_resolve_window_row(struct apptree_control *control,
+										int row);
+static void apptree_fill_window(struct apptree_control *control);
+#endif
+static const char *apptree_picture_title(struct apptree_control *control,
+											int index);
+static size_t apptree_picture_title_len(struct apptree_control *control,
+										int index);
+static void apptree_print_keybindings(struct apptree_control *control);
+static size_t apptree_string_len(const char *str, size_t len, size_t max);
+static void apptree_print_info(struct apptree_control *control);
+static const char *apptree_get_arrow(struct apptree_control *control,
+										int index);
+static const char *apptree_get_marker(struct apptree_node *parent,
+										int child_index);
+#if APPTREE_ROW_CACHE_SIZE
+static struct apptree_row_page *apptree_build_row_page(
+									struct apptree_control *control);
+static struct apptree_row_page *apptree_find_row_page(
+									struct apptree_control *control);
+static void apptree_print_cached_row(struct apptree_control *control,
+										struct apptree_row_page *page,
+										int index);
+#endif
+static void apptree_touch_rows(struct apptree_tree *tree,
+								struct apptree_node *node);
+static void apptree_print_frame_row(struct apptree_control *control,
+									int index);
+static void apptree_print_title(struct apptree_control *control);
+static void apptree_print_row(struct apptree_control *control, int row);
+static void apptree_print_line(struct apptree_control *control, int row);
+static void apptree_scroll_frame(struct apptree_control *control);
+static void apptree_print_menu(struct apptree_control *control);
+static void apptree_schedule_menu(struct apptree_control *control);
+
+static int apptree_validate_node(struct apptree_tree *tree,
+									struct apptree_node *node);
+static struct apptree_node *apptree_attach_node(struct apptree_tree *tree,
+		struct apptree_node *parent,
+		char *title,
+		char *info,
+		enum apptree_mode mode,
+		bool selected,
+		void (*function)(struct apptree_node *parent, int child_idx));
+static int apptree_validate_spec(struct apptree_node *parent,
+									const struct apptree_node_spec *spec,
+									int index);
+static void apptree_undo_subtree(struct apptree_tree *tree,
+									struct apptree_node **nodes,
+									struct apptree_node *first,
+									int count);
+static struct apptree_node **apptree_index_node(struct apptree_node *node,
+												struct apptree_node **slot);
+static int apptree_build_index(struct apptree_tree *tree);
+static bool apptree_is_end(const struct apptree_node *node);
+static struct apptree_parent_state *apptree_get_parent_state(
+											const struct apptree_node *node);
+static int apptree_count_selection_words(struct apptree_node *node,
+											int *parents);
+static void apptree_track_selection(struct apptree_node *node,
+									uint32_t **words,
+									struct apptree_parent_state **parents);
+static int apptree_build_selection(struct apptree_tree *tree);
+#if APPTREE_TYPE_AHEAD
+static int apptree_compare_text(const char *a, const char *b, size_t len);
+static void apptree_sort_children(struct apptree_node *node, int *sorted);
+static int *apptree_sort_node(struct apptree_node *node, int *slot);
+static int apptree_build_sorted(struct apptree_tree *tree);
+static int *apptree_sorted_children(struct apptree_tree *tree,
+									struct apptree_node *node);
+static int apptree_find_prefix(struct apptree_tree *tree,
+								struct apptree_node *node,
+								const char *prefix, int len);
+#endif
 
-static int apptree_validate_node(struct apptree_node *block);
+#if APPTREE_IMAGE
+static int apptree_validate_string(const struct apptree_image_header *header,
+									uint32_t offset, size_t max);
+static int apptree_validate_image(const struct apptree_node *parent,
+									const struct apptree_image_header *header,
+									size_t size, int num_functions);
+static int apptree_image_function(
+		void (*const functions[])(struct apptree_node *parent, int child_idx),
+		int num_functions,
+		void (*function)(struct apptree_node *parent, int child_idx));
+static int apptree_size_image(const struct apptree_node *node,
+								uint32_t *num_nodes, uint32_t *strings_size);
+static uint32_t apptree_export_string(char *strings, uint32_t *offset,
+										const char *str, size_t max);
+static int apptree_export_node(const struct apptree_node *node,
+		uint32_t parent,
+		struct apptree_image_header *header,
+		void (*const functions[])(struct apptree_node *parent, int child_idx),
+		int num_functions);
+#endif
 
-static void apptree_adjust_frame_pos(void);
-static void apptree_increase_select_pos(void);
-static void apptree_decrease_select_pos(void);
+static void apptree_adjust_frame_pos(struct apptree_control *control);
+static void apptree_increase_select_pos(struct apptree_control *control);
+static void apptree_decrease_select_pos(struct apptree_control *control);
 static void apptree_update_selected(struct apptree_node *parent,
 									int child_index);
 
-static void apptree_handle_up_input(void);
-static void apptree_handle_down_input(void);
-static void apptree_handle_select_input(void);
-static void apptree_handle_back_input(void);
-static void apptree_handle_home_input(void);
+static void apptree_trim_selection(struct apptree_node *parent,
+									struct apptree_parent_state *record);
+
+static void apptree_handle_move_input(struct apptree_control *control,
+										int moves);
+static void apptree_handle_select_input(struct apptree_control *control);
+static void apptree_handle_back_input(struct apptree_control *control);
+static void apptree_build_key_map(struct apptree_control *control);
+static enum apptree_action apptree_decode_sequence(unsigned char param,
+													unsigned char final);
+static enum apptree_action apptree_decode_input(struct apptree_control *control,
+												char input);
+static void apptree_handle_home_input(struct apptree_control *control);
+#if APPTREE_PATH_DEPTH
+static void apptree_restore_crumb(struct apptree_control *control,
+									const struct apptree_crumb *crumb);
+#endif
+static void apptree_move_to(struct apptree_control *control,
+							int select_pos, int frame_pos);
+static void apptree_handle_page_input(struct apptree_control *control,
+										int pages);
+#if APPTREE_TYPE_AHEAD
+static void apptree_handle_search_input(struct apptree_control *control,
+										char input);
+#endif
 
+static int apptree_open_structure(struct apptree_control *control);
+static void apptree_thaw_selection(struct apptree_node *node);
+static int apptree_measure_tree(struct apptree_node *node, int *words,
+								int *parents);
+static void apptree_relink_tree(struct apptree_node *node);
+static int apptree_detach_nodes(struct apptree_node *node);
+static void apptree_free_nodes(struct apptree_node *node);
+static int apptree_rebuild_tree(struct apptree_control *control);
+static int apptree_validate_message(struct apptree_tree *tree,
+									const struct apptree_message *message);
+static void apptree_set_selected(struct apptree_node *node, bool selected);
+static void apptree_set_selected_flag(struct apptree_node *node,
+										bool selected);
+static void apptree_apply_message(struct apptree_control *control,
+									const struct apptree_message *message);
+#if APPTREE_MESSAGE_QUEUE_SIZE
+static int apptree_process_messages(struct apptree_control *control);
+static void apptree_drop_messages(struct apptree_control *control);
+#endif
+#if APPTREE_STATS
+static void apptree_record_time(struct apptree_control *control,
+								uint32_t start);
+#endif
 
-static struct apptree_control control;
 
 
 /** @name Initialization Functions
@@ -49,6 +192,10 @@ static struct apptree_control control;
  *	variables used by the apptree. It also creates a master node which
  *	subsequent nodes will grow from and binds the key inputs.
  *
+ *	Every apptree session is kept in its own apptree_control, so one firmware
+ *	can drive several displays at the same time. A session either creates its
+ *	own tree, or shares the tree of another session with apptree_init_shared.
+ *
  *	@note The apptree uses the standard C library (printf) for printing its
  *	output. The standard ouput (serial, LCD, etc) is expected to be properly
  *	configured and binded to the printf function prior to calling the init
@@ -57,52 +204,152 @@ static struct apptree_control control;
 /** @{*/
 
 /** @brief Binds input keys
+ *	@param control The apptree session.
  *	@param key Pointer to key binding struct.
  *	@returns 0 if successful and -1 if otherwise.
  */
-static int apptree_bind_keys(struct apptree_keybindings *key)
+static int apptree_bind_keys(struct apptree_control *control,
+								struct apptree_keybindings *key)
 {
 	if (key == NULL)
 		return -1;
 	
-	control.keys = key;
+	control->keys = key;
+#if APPTREE_TYPE_AHEAD
+	control->search_len = 0;
+#endif
 	return 0;
 }
 
+/** @brief Allocates a node
+ *	@param tree The tree the node is allocated for.
+ *	@returns The zeroed node if successful and NULL if otherwise.
+ *
+ *	Nodes are handed out from the pool in order if one has been supplied to
+ *	apptree_init_pool, and are allocated from the heap otherwise.
+ */
+static struct apptree_node *apptree_alloc_node(struct apptree_tree *tree)
+{
+	struct apptree_node *node;
+	
+	if (tree->pool == NULL) {
+#if APPTREE_STATS
+		tree->allocations++;
+#endif
+		return (struct apptree_node *)calloc(1, sizeof(struct apptree_node));
+	}
+	
+	if (tree->pool->used == tree->pool->size)
+		return NULL;
+	
+	node = &tree->pool->nodes[tree->pool->used++];
+	memset(node, 0, sizeof(struct apptree_node));
+	
+	return node;
+}
+
 /**	@brief Creates a master node.
+ *	@param tree The tree the master node is created for.
  *	@param master Handle for holoding the master node.
  *	@param title Title for the master node.
  *	@param mode Mode of the master node.
  *	@returns 0 if successful and -1 if otherwise.
  */
-static int apptree_create_master(struct apptree_node **master,
+static int apptree_create_master(struct apptree_tree *tree,
+									struct apptree_node **master,
 									char *title,
 									enum apptree_mode mode)
 {
 	struct apptree_node *node;
 	
-	node = (struct apptree_node *)calloc(1, sizeof(struct apptree_node));
+	node = apptree_alloc_node(tree);
 	if (node == NULL)
 		return -1;
 	
-	INIT_LIST_HEAD(&node->list_parent);
-	INIT_LIST_HEAD(&node->list_child);
-	
 	node->title 	= title;
 	node->info 		= NULL;
+	node->title_len	= apptree_string_len(title, 0, MAX_TITLE_WIDTH);
+	node->info_len	= 0;
 	node->parent	= NULL;
+	node->tree		= tree;
+	node->last_child	= NULL;
+	node->prev_sibling	= NULL;
 	node->mode		= mode;
 	node->num_child = 0;
-	node->selected	= false;
-	node->end		= false;
+	node->state		= &node->state_storage;
+	node->state->selected = false;
 	node->function 	= NULL;
+	node->children	= NULL;
 	
 	*master = node;
 	
 	return 0;
 }
 
+/** @brief Initializes a session showing a tree
+ *	@param control The apptree session.
+ *	@param tree The tree to be shown.
+ *	@param read_input Non-blocking function for reading user input.
+ *	@param write_output Blocking function for writing output.
+ */
+static void apptree_init_session(struct apptree_control *control,
+									struct apptree_tree *tree,
+									int (*read_input)(char *input),
+									void (*write_output)(char output))
+{
+#if APPTREE_ROW_CACHE_SIZE
+	int i;
+	
+#endif
+	apptree_io_init(&control->io, read_input, write_output);
+	
+	control->tree			= tree;
+	control->current		= tree->master;
+	control->picture 		= NULL,
+	control->picture_height = 0;
+	control->frame_pos 		= 0;
+	control->select_pos 	= 0;
+	control->enabled 		= 0;
+	control->incremental	= false;
+	control->render_row		= TERMINAL_HEIGHT;
+	control->redraw			= false;
+	control->frame_interval	= 0;
+	control->frame_ticks	= 0;
+	control->update_depth	= 0;
+	control->update_structure = false;
+	control->removed		= NULL;
+#if APPTREE_PATH_DEPTH
+	control->path_len		= 0;
+#endif
+	
+#if APPTREE_ROW_CACHE_SIZE
+	for (i = 0; i < APPTREE_ROW_CACHE_PAGES; i++) {
+		control->row_cache[i].node		= NULL;
+		control->row_cache[i].last_used	= 0;
+	}
+	control->row_clock		= 0;
+	control->row_rejected	= NULL;
+#endif
+	
+#if APPTREE_STATS
+	control->timestamp		= NULL;
+#endif
+	
+#if APPTREE_DIFF_RENDER
+	control->shown_node		= NULL;
+	control->shown_frame_pos = 0;
+#endif
+	
+#if APPTREE_MESSAGE_QUEUE_SIZE
+	control->message_head	= 0;
+	control->message_tail	= 0;
+	control->lock			= NULL;
+	control->unlock			= NULL;
+#endif
+}
+
 /** @brief Initializes the apptree and creates a master node.
+ *	@param control The apptree session.
  *	@param master Handle for holding the master node.
  *	@param master_title Title for the master node.
  *	@param mode Mode of the master node.
@@ -113,549 +360,3940 @@ static int apptree_create_master(struct apptree_node **master,
  *	@note This function should be called before any nodes are added to
  *	the tree.
  */
-int apptree_init(struct apptree_node **master,
+int apptree_init(struct apptree_control *control,
+					struct apptree_node **master,
 					char *master_title,
 					enum apptree_mode master_mode,
 					struct apptree_keybindings *key,
 					int (*read_input)(char *input),
 					void (*write_output)(char output))
 {
-	if ((read_input == NULL) || (write_output == NULL))
+	return apptree_init_pool(control, master, master_title, master_mode, key,
+								read_input, write_output, NULL);
+}
+
+/** @brief Initializes the apptree with nodes taken from a pool.
+ *	@param control The apptree session.
+ *	@param master Handle for holding the master node.
+ *	@param master_title Title for the master node.
+ *	@param mode Mode of the master node.
+ *	@param key Key binding for the apptree.
+ *	@param read_input Non-blocking function for reading user input.
+ *	@param write_output Blocking function for writing output.
+ *	@param pool Storage for the nodes, or NULL to allocate them from the heap.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	Works like apptree_init, except that the master and every subsequent node
+ *	are handed out from the pool with a bump allocator, as is the child index
+ *	built by apptree_enable. A tree built this way does not touch the heap and
+ *	has a footprint fixed at compile time. Once the pool is used up,
+ *	apptree_create_node fails. Use APPTREE_POOL to declare a pool.
+ */
+int apptree_init_pool(struct apptree_control *control,
+						struct apptree_node **master,
+						char *master_title,
+						enum apptree_mode master_mode,
+						struct apptree_keybindings *key,
+						int (*read_input)(char *input),
+						void (*write_output)(char output),
+						struct apptree_pool *pool)
+{
+	struct apptree_tree *tree;
+	
+	if ((control == NULL) || (read_input == NULL) || (write_output == NULL))
 		return -1;
 	
-	if (apptree_bind_keys(key))
+	if (apptree_bind_keys(control, key))
 		return -1;
 	
-	if (apptree_create_master(master, master_title, master_mode))
+	tree = &control->tree_storage;
+	tree->pool = pool;
+	if (pool)
+		pool->used = 0;
+#if APPTREE_STATS
+	tree->allocations = 0;
+#endif
+	
+	if (apptree_create_master(tree, master, master_title, master_mode))
 		return -1;
 	
-	apptree_io_init(read_input, write_output);
+	tree->master	= *master;
+	tree->index		= NULL;
+	tree->selection	= NULL;
+	tree->parents	= NULL;
+	tree->num_nodes	= 1;
+	tree->num_sessions = 1;
+	tree->frozen	= false;
+#if APPTREE_TYPE_AHEAD
+	tree->sorted	= NULL;
+#endif
+#if APPTREE_ROW_CACHE_SIZE
+	tree->generation = 0;
+#endif
 	
-	control.master 			= *master;
-	control.current			= *master;
-	control.picture 		= NULL,
-	control.picture_height 	= 0;
-	control.frame_pos 		= 0;
-	control.select_pos 		= 0;
-	control.enabled 		= 0;
+	apptree_init_session(control, tree, read_input, write_output);
 	
 	return 0;
 }
 
-/** @}*/
-
-/* -------------------------------------------------------------------------- */
-/** @name Printing Functions
- *	Handles the printing of the apptree to the output media.
- */
-/** @{*/
-
-/** @brief Populates the picture
- *	
- *	The picture is populated with the titles of all the children belonging
- *	to the current node.
+/** @brief Initializes the apptree with a constant tree.
+ *	@param control The apptree session.
+ *	@param master The master node of the tree.
+ *	@param key Key binding for the apptree.
+ *	@param read_input Non-blocking function for reading user input.
+ *	@param write_output Blocking function for writing output.
+ *	@returns 0 if successful and -1 if otherwise.
  *
- *	@note Ensure that the picture size is the same as the number of children in
- *	the current node before calling. Call the function apptree_resize_picture
- *	if the size is incorrect.
+ *	The tree is declared at compile time with APPTREE_CONST_NODE and
+ *	APPTREE_CONST_LEAF, which lets the linker place the nodes in read-only
+ *	memory. Only the state of each node is kept in RAM. The tree is walked
+ *	directly, so there is no setup phase and apptree_create_node fails.
  */
-static void apptree_populate_picture(void)
+int apptree_init_const(struct apptree_control *control,
+						const struct apptree_node *master,
+						struct apptree_keybindings *key,
+						int (*read_input)(char *input),
+						void (*write_output)(char output))
 {
-	struct list_head *head;
-	struct apptree_node *node;
-	int i;
+	struct apptree_tree *tree;
 	
-	for (i = 0; i < control.current->num_child; i++) {
-		head = list_travese_to_index(&control.current->list_parent, i);
-		node = container_of(head, struct apptree_node, list_child);
-		control.picture[i] = node->title;
-	}
+	if ((control == NULL) || (master == NULL) ||
+		(read_input == NULL) || (write_output == NULL))
+		return -1;
+	
+	if (apptree_bind_keys(control, key))
+		return -1;
+	
+	tree = &control->tree_storage;
+	tree->master	= (struct apptree_node *)master;
+	tree->pool		= NULL;
+	tree->index		= NULL;
+	tree->selection	= NULL;
+	tree->parents	= NULL;
+	tree->num_nodes	= 0;
+	tree->num_sessions = 1;
+	tree->frozen	= true;
+#if APPTREE_TYPE_AHEAD
+	tree->sorted	= NULL;
+#endif
+#if APPTREE_ROW_CACHE_SIZE
+	tree->generation = 0;
+#endif
+#if APPTREE_STATS
+	tree->allocations = 0;
+#endif
+	
+	apptree_track_selection(tree->master, NULL, NULL);
+	apptree_init_session(control, tree, read_input, write_output);
+	
+	return 0;
 }
 
-/** @brief Resizes the picture
- *	@returns 0 if sucessful and -1 if otherwise.
+/** @brief Initializes the apptree with the tree of another session.
+ *	@param control The apptree session.
+ *	@param owner The session which created the tree, with any of the other
+ *	init functions.
+ *	@param key Key binding for the apptree.
+ *	@param read_input Non-blocking function for reading user input.
+ *	@param write_output Blocking function for writing output.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	Both sessions show the same tree, which is only kept in memory once, but
+ *	each of them has its own position in the tree, input and output. The tree
+ *	is frozen as soon as either session is enabled, after which nodes can no
+ *	longer be added through any of them. The selected state of the nodes is
+ *	part of the tree, so a selection made on one display shows on the other
+ *	once it is next printed. Nodes can no longer be added to or removed from
+ *	the tree within an update once it is shared.
  *
- *	The picture is dynamically resized using realloc according to the number of
- *	children of the current node.
+ *	@note The owner must not be initialized again while the tree is shared.
  */
-static int apptree_resize_picture(void)
-{	
-	char **temp;
+int apptree_init_shared(struct apptree_control *control,
+						struct apptree_control *owner,
+						struct apptree_keybindings *key,
+						int (*read_input)(char *input),
+						void (*write_output)(char output))
+{
+	if ((control == NULL) || (owner == NULL) || (owner->tree == NULL) ||
+		(read_input == NULL) || (write_output == NULL))
+		return -1;
 	
-	temp = realloc(control.picture, control.picture_height * sizeof(char **));
-	if (temp == NULL)
+	if (apptree_bind_keys(control, key))
 		return -1;
 	
-	control.picture = temp;
+	owner->tree->num_sessions++;
+	apptree_init_session(control, owner->tree, read_input, write_output);
+	
 	return 0;
 }
 
-/** @brief Prints keybindings
- *	@note This function should only be called by apptree_print_menu.
+/** @brief Binds a block writer for the output.
+ *	@param control The apptree session.
+ *	@param write_block Blocking function for writing a block of outputs, or
+ *	NULL to write one character at a time through write_output.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	When a block writer is binded, each menu is staged in a fixed-size buffer
+ *	of APPTREE_TX_BUFFER_SIZE and handed over in bulk, which allows DMA capable
+ *	drivers to send a frame in as few transfers as possible.
+ *
+ *	@note This function should be called after apptree_init.
  */
-static void apptree_print_keybindings(void)
+int apptree_set_write_block(struct apptree_control *control,
+							void (*write_block)(const char *buf, size_t len))
 {
-	apptree_print("KEY BINDINGS => UP:[%c]  DOWN:[%c]  SELECT:[%c]  BACK:[%c]  HOME:[%c]\r\n",
-		control.keys->up, control.keys->down, control.keys->select,
-		control.keys->back, control.keys->home);
+	if (control->tree == NULL)
+		return -1;
+	
+	apptree_io_set_write_block(&control->io, write_block);
+	return 0;
 }
 
-/** @brief Prints the info of a pointed item
+/** @brief Binds a vectored writer for the output.
+ *	@param control The apptree session.
+ *	@param write_vector Blocking function for writing a list of segments, or
+ *	NULL to go back to writing through write_block or write_output.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	When a vectored writer is binded, the pieces of each row of the frame are
+ *	handed over as a single gather write, without being copied or scanned.
+ *
+ *	@note This function should be called after apptree_init.
  */
-static void apptree_print_info(void)
+int apptree_set_write_vector(struct apptree_control *control,
+								void (*write_vector)(
+								const struct apptree_iovec *iov, int count))
 {
-	struct list_head *head;
-	struct apptree_node *node;
-
-	head = list_travese_to_index(&control.current->list_parent, control.select_pos);
-	node = container_of(head, struct apptree_node, list_child);
+	if (control->tree == NULL)
+		return -1;
 	
-	apptree_print("< %s >\r\n", node->info);
+	apptree_io_set_write_vector(&control->io, write_vector);
+	return 0;
 }
 
-/** @brief Prints the select arrow
- *	@param index Index of the item which the arrow is pointed on.
+/** @brief Enables or disables the diff render mode.
+ *	@param control The apptree session.
+ *	@param enable Set as true to only redraw the lines that have changed.
+ *	@param goto_line Function for moving the output cursor to the start of a
+ *	line, counted from 0 at the top of the display. Pass NULL to use VT100
+ *	cursor positioning escape sequences.
+ *	@returns 0 if successful and -1 if otherwise.
  *
- *	@note This function should only be called by apptree_print_menu.
+ *	In diff render mode, a shadow copy of the last printed menu is kept and
+ *	each input only sends the lines which differ from it. The first menu
+ *	printed after enabling clears the display and draws every line.
+ *
+ *	@note The apptree has to be compiled with APPTREE_DIFF_RENDER set to 1 for
+ *	this mode to be available.
  */
-static void apptree_print_select(int index)
+int apptree_set_diff_render(struct apptree_control *control,
+							bool enable, void (*goto_line)(int line))
 {
-	if (index == control.select_pos)
-		apptree_print(" -> ");
-	else
-		apptree_print("    ");
+#if APPTREE_DIFF_RENDER
+	if (control->tree == NULL)
+		return -1;
+	
+	apptree_io_set_diff_render(&control->io, enable, goto_line);
+	return 0;
+#else
+	(void)control;
+	(void)enable;
+	(void)goto_line;
+	return -1;
+#endif
 }
 
-/** @brief Print the selected marker of a node
- *	@param parent The parent of the node.
- *	@param child_index The position of the node as a child to its parent.
- *	
- *	This function prints out the selected marker of a node if its parent is not
- *	Simple.
+/** @brief Binds a display backend for the output.
+ *	@param control The apptree session.
+ *	@param display The display through which the menu is drawn, such as
+ *	apptree_terminal_display, apptree_null_display or a custom one.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	The terminal display, which streams the menu through write_output, is
+ *	binded by default. The null display draws nothing, which is useful to
+ *	measure the cost of navigating the tree on its own.
+ *
+ *	@note This function should be called after apptree_init.
  */
-static void apptree_print_selected(struct apptree_node *parent,
-									int child_index)
+int apptree_set_display(struct apptree_control *control,
+						const struct apptree_display *display)
 {
-	struct list_head *head;
-	struct apptree_node *node;
-
-	head = list_travese_to_index(&parent->list_parent, child_index);
-	node = container_of(head, struct apptree_node, list_child);
-	
-	if (parent->mode == APPTREE_MODE_SIMPLE)
-		return;
+	if ((control->tree == NULL) || (display == NULL))
+		return -1;
 	
-	if (node->selected)
-		apptree_print("[*] ");
-	else
-		apptree_print("[ ] ");
+	apptree_io_set_display(&control->io, display);
+	return 0;
 }
 
-/** @brief Prints a frame
+/** @brief Binds a framebuffer as the display for the output.
+ *	@param control The apptree session.
+ *	@param ram The display RAM, holding height rows of width characters.
+ *	@param width The number of characters in a row.
+ *	@param height The number of rows.
+ *	@param refresh Optional function called after each menu with the range of
+ *	rows which have changed, or NULL if ram is the display itself.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	The rows of the menu are copied straight into the display RAM, such as
+ *	that of a character LCD, without any formatting or escape sequences. A
+ *	display smaller than the terminal only shows the top left of the menu.
+ *
+ *	@note This function should be called after apptree_init.
  */
-static void apptree_print_frame(void)
+int apptree_set_framebuffer(struct apptree_control *control,
+							char *ram, int width, int height,
+							void (*refresh)(int first_row, int last_row))
 {
-	int end, start = control.frame_pos;
-	int i, j;
+	if ((control->tree == NULL) || (ram == NULL) ||
+		(width <= 0) || (height <= 0))
+		return -1;
 	
-	if (control.picture_height <= FRAME_HEIGHT) {
-		
-		for (i = start; i < control.picture_height; i++) {
-			apptree_print_select(i);
-			apptree_print_selected(control.current, start + i);
-			apptree_print("%2d. %s\r\n", i+1, control.picture[i]);
-		}
-
-		for (j = i; j < FRAME_HEIGHT; j++)
-			apptree_print("\r\n");
-	} else {
-		end = control.frame_pos + FRAME_HEIGHT;
-		
-		for (i = start; i < end; i++)
-		{
-			apptree_print_select(i);
-			apptree_print("%2d. %s\r\n", i+1, control.picture[i]);
-		}
-	}
+	apptree_io_set_framebuffer(&control->io, ram, width, height, refresh);
+	return 0;
 }
 
-/**	@brief Prints the title of the current parent node
+/** @brief Enables or disables scrolling with VT100 scroll regions.
+ *	@param control The apptree session.
+ *	@param enable Set as true to scroll the frame on the display when the
+ *	select arrow moves beyond it.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	When the frame moves by a few rows, the rows of the frame which are still
+ *	shown are shifted within a VT100 scroll region instead of being drawn
+ *	again. Together with the diff render mode, a step of the frame then only
+ *	sends the row scrolled in and the moved select arrow.
+ *
+ *	@note The apptree has to be compiled with APPTREE_DIFF_RENDER set to 1,
+ *	and diff render has to be enabled without a goto_line function, for this
+ *	to take effect.
  */
-static void apptree_print_title(void)
+int apptree_set_scroll_region(struct apptree_control *control, bool enable)
 {
-	apptree_print("%s\r\n", control.current->title);
+#if APPTREE_DIFF_RENDER
+	if (control->tree == NULL)
+		return -1;
+	
+	apptree_io_set_scroll_region(&control->io, enable);
+	return 0;
+#else
+	(void)control;
+	(void)enable;
+	return -1;
+#endif
 }
 
-/** @brief Prints a blank line.
+/** @brief Enables or disables the incremental render mode.
+ *	@param control The apptree session.
+ *	@param enable Set as true to render through apptree_render_step.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	In incremental render mode, input handling only updates the state of the
+ *	apptree and schedules the menu. The menu is then written a few characters
+ *	at a time by calling apptree_render_step, for instance once per loop of a
+ *	cooperative scheduler, so that no single call blocks for long.
  */
-static void apptree_print_blank(void)
+int apptree_set_incremental_render(struct apptree_control *control,
+									bool enable)
 {
-	apptree_print("\r\n");
+	if (control->tree == NULL)
+		return -1;
+	
+	if (!enable)
+		while (apptree_render_step(control, APPTREE_TX_BUFFER_SIZE))
+			;
+	
+	apptree_io_set_deferred(&control->io, enable);
+	control->incremental = enable;
+	control->render_row	 = TERMINAL_HEIGHT;
+	return 0;
 }
 
-/**	@brief Prints the menu.
- *	Prints the menu which consists of the title, info and frame in that order.
+/** @brief Limits the rate at which menus are printed.
+ *	@param control The apptree session.
+ *	@param interval The minimum number of calls to apptree_tick between two
+ *	menus, or 0 to print each menu as soon as it changes.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	With a frame limit, handling inputs only marks the menu as changed, and
+ *	the menu is printed by apptree_tick once the interval has passed since
+ *	the last menu and that menu has been written in full. Any states shown in
+ *	between are skipped, so a burst of inputs costs a single menu showing
+ *	its final state. A menu still waiting is printed when the limit is
+ *	removed.
  */
-static void apptree_print_menu(void)
+int apptree_set_frame_limit(struct apptree_control *control, int interval)
 {
-	apptree_print_blank();
-	apptree_print_title();
-	apptree_print_blank();
-	apptree_print_frame();
-	apptree_print_blank();
-	apptree_print_info();
-	apptree_print_keybindings();
+	if ((control->tree == NULL) || (interval < 0))
+		return -1;
+	
+	control->frame_interval = interval;
+	control->frame_ticks	= interval;
+	
+	if ((interval == 0) && control->redraw && control->enabled)
+		apptree_schedule_menu(control);
+	
+	return 0;
 }
 
 /** @}*/
 
 /* -------------------------------------------------------------------------- */
-/** @name Setup Functions
- *	Handles node creation. Before any nodes can be added into the tree, the
- *	initialization function has to be called.
+/** @name Printing Functions
+ *	Handles the printing of the apptree to the output media.
  */
 /** @{*/
 
-/** @brief Checks if a node is attached to the tree
- *	@returns 0 if yes and -1 if otherwise
- *	
- *	A node is attached to the tree if it has the master node as its encestor.
+/** @brief Counts the children of a node
+ *	@param node The node.
+ *	@returns The number of children, or of items if the node is lazy.
  */
-static int apptree_validate_node(struct apptree_node *block)
+static int apptree_count_children(struct apptree_node *node)
 {
-	struct apptree_node *node = block;
+#if APPTREE_LAZY_NODES
+	if (node->provider)
+		return node->provider->count(node);
+#endif
 	
-	do {
-		node = node->parent;
-	} while (node->parent != NULL);
-	
-	if (node != control.master)
-		return -1;
-	else
-		return 0;
+	return node->num_child;
 }
 
-/** @brief Creates a node and attaches it to the tree
- *	@param new_node Handle for holding the new node.
- *	@param parent Parent node to attach the new node to.
- *	@param title Title message of the new node.
- *	@param info Info message of the new node.
- *	@param mode Mode of the node.
- *	@param selected Indicated whether this node should be set as selected.
- *	@param function Function to bind to this node.
- *	@returns 0 if successful and -1 if otherwise.
- *
- *	This function dynamically allocates memory to create a new node and
- *	subsequently attaches it to an existing parent in the tree. This function
- *	will fail under two circumstances:
+/** @brief Populates the picture
+ *	@param control The apptree session.
  *	
- *		1. The apptree_enable function has been called.
- *		2. The parent function is an end node.
+ *	The picture is a view onto the child index of the current node, so
+ *	changing levels neither allocates memory nor copies the titles of the
+ *	children. Lazy nodes have no child index, so only the titles within the
+ *	frame are resolved into the window.
+ */
+static void apptree_populate_picture(struct apptree_control *control)
+{
+	control->picture = control->current->children;
+	control->picture_height = apptree_count_children(control->current);
+	
+#if APPTREE_LAZY_NODES
+	control->window_pos = -1;
+	apptree_fill_window(control);
+#endif
+}
+
+/** @brief Refreshes the picture
+ *	@param control The apptree session.
  *
- *	@note The children of a node which is not Simple (either Single Selection
- *	or Multi Selection) is automatically set as an end node. An end node will
- *	not be able to have children. Also, if a parent node is set to Single
- *	Selection, only one of its children can be set as selected.
+ *	The children of the current node are counted again, and the frame and
+ *	select arrow are pulled back within the picture should it have shrunk.
+ *	The window of a lazy node is resolved again in full.
  */
-int apptree_create_node(struct apptree_node **new_node,
-		struct apptree_node *parent,
-		char *title,
-		char *info,
-		enum apptree_mode mode,
-		bool selected,
-		void (*function)(struct apptree_node *parent, int child_idx))
-{	
-	struct apptree_node *node;
+static void apptree_refresh_picture(struct apptree_control *control)
+{
+	int last_frame_pos;
 	
-	if (control.enabled)
-		return -1;
+	control->picture_height = apptree_count_children(control->current);
 	
-	if (parent->end)
-		return -1;
+	if (control->select_pos >= control->picture_height)
+		control->select_pos = control->picture_height - 1;
+	if (control->select_pos < 0)
+		control->select_pos = 0;
 	
-	node = (struct apptree_node *)calloc(1, sizeof(struct apptree_node));
-	if (node == NULL)
-		return -1;
-
-	node->parent = parent;
-	if (apptree_validate_node(node)) {
-		free(node);
-		return -1;
-	}
+	last_frame_pos = control->picture_height - FRAME_HEIGHT;
+	if (control->frame_pos > last_frame_pos)
+		control->frame_pos = last_frame_pos;
+	if (control->frame_pos > control->select_pos)
+		control->frame_pos = control->select_pos;
+	if (control->frame_pos < 0)
+		control->frame_pos = 0;
 	
-	INIT_LIST_HEAD(&node->list_parent);
+#if APPTREE_LAZY_NODES
+	control->window_pos = -1;
+	apptree_fill_window(control);
+#endif
+}
+
+#if APPTREE_LAZY_NODES
+/** @brief Resolves the title of an item into a row of the window
+ *	@param control The apptree session.
+ *	@param row The row of the window.
+ */
+static void apptree_resolve_window_row(struct apptree_control *control,
+										int row)
+{
+	int index = control->frame_pos + row;
+	const char *title;
 	
-	INIT_LIST_HEAD(&node->list_child);
-	list_add_tail(&node->list_child, &parent->list_parent);
-	parent->num_child++;
+	control->window[row][0] = '\0';
 	
-	if (parent->mode != APPTREE_MODE_SIMPLE)
-		node->end = true;
-	else
-		node->end = false;
+	if (index >= control->picture_height)
+		return;
 	
-	node->title	 	= title;
-	node->info	 	= info;
-	node->mode		= mode;
-	node->num_child = 0;
-	node->selected	= selected;
-	node->function	= function;
-
-	*new_node = node;
+	title = control->current->provider->title(control->current, index);
+	APPTREE_STATS_ADD(&control->io, lazy_resolves, 1);
+	if (title == NULL)
+		return;
 	
-	return 0;
+	strncpy(control->window[row], title, MAX_TITLE_WIDTH);
+	control->window[row][MAX_TITLE_WIDTH] = '\0';
 }
 
-/** @brief Enables the apptree
- *	@returns 0 if successful and -1 if otherwise.
+/** @brief Fills the window of a lazy node
+ *	@param control The apptree session.
  *
- *	This function is called at the end of the setup phase (after all nodes have
- *	been added. It enables the apptree and prints the menu with the master node
- *	as the current node. The enabled flag is also set to prevent changes in the
- *	tree structure.
+ *	The window holds the titles of the items within the frame. When the frame
+ *	has scrolled by a single row since the window was filled, the window is
+ *	shifted and only the new row is resolved. Otherwise every row is resolved.
+ *	Does nothing if the current node is not lazy.
  */
-int apptree_enable(void)
+static void apptree_fill_window(struct apptree_control *control)
 {
-	if (control.master == NULL)
-		return -1;
+	int shift = control->frame_pos - control->window_pos;
+	int row;
 	
-	if (control.keys == NULL)
-		return -1;
-	
-	control.current = control.master;
-	control.picture_height = control.master->num_child;
+	if (control->current->provider == NULL)
+		return;
 	
-	control.enabled = true;
+	if ((control->window_pos >= 0) && (shift == 0))
+		return;
 	
-	apptree_resize_picture();
-	apptree_populate_picture();
-	apptree_print_menu();
+	if ((control->window_pos >= 0) && (shift == 1)) {
+		memmove(control->window[0], control->window[1],
+				(FRAME_HEIGHT - 1) * sizeof(control->window[0]));
+		apptree_resolve_window_row(control, FRAME_HEIGHT - 1);
+	} else if ((control->window_pos >= 0) && (shift == -1)) {
+		memmove(control->window[1], control->window[0],
+				(FRAME_HEIGHT - 1) * sizeof(control->window[0]));
+		apptree_resolve_window_row(control, 0);
+	} else {
+		for (row = 0; row < FRAME_HEIGHT; row++)
+			apptree_resolve_window_row(control, row);
+	}
 	
-	return 0;
+	control->window_pos = control->frame_pos;
 }
+#endif
 
-/** @}*/
+/** @brief Gets the title of an item in the picture
+ *	@param control The apptree session.
+ *	@param index Index of the item in the picture, which must be in the frame.
+ *	@returns The title of the item.
+ */
+static const char *apptree_picture_title(struct apptree_control *control,
+											int index)
+{
+#if APPTREE_LAZY_NODES
+	if (control->current->provider)
+		return control->window[index - control->frame_pos];
+#endif
+	
+	return control->picture[index]->title;
+}
 
+/** @brief Gets the length of the title of an item in the picture
+ *	@param control The apptree session.
+ *	@param index Index of the item in the picture, which must be in the frame.
+ *	@returns The length of the title of the item.
+ */
+static size_t apptree_picture_title_len(struct apptree_control *control,
+										int index)
+{
+	struct apptree_node *node;
+	
+#if APPTREE_LAZY_NODES
+	if (control->current->provider)
+		return strlen(control->window[index - control->frame_pos]);
+#endif
+	
+	node = control->picture[index];
+	return apptree_string_len(node->title, node->title_len, MAX_TITLE_WIDTH);
+}
 
-/* -------------------------------------------------------------------------- */
-/** @name Input Handling Functions
- *	Handles the user input as well as any subsequent results from the input.
+/** @brief Prints keybindings
+ *	@param control The apptree session.
+ *	@note This function should only be called by apptree_print_row.
  */
-/** @{*/
+static void apptree_print_keybindings(struct apptree_control *control)
+{
+	const struct apptree_keybindings *keys = control->keys;
+	const struct apptree_iovec iov[11] = {
+		{ "KEY BINDINGS => UP:[", 20 }, { &keys->up, 1 },
+		{ "]  DOWN:[", 9 }, { &keys->down, 1 },
+		{ "]  SELECT:[", 11 }, { &keys->select, 1 },
+		{ "]  BACK:[", 9 }, { &keys->back, 1 },
+		{ "]  HOME:[", 9 }, { &keys->home, 1 },
+		{ "]", 1 }
+	};
+	
+	apptree_putv(&control->io, iov, 11);
+}
 
-/** @brief Adjust the value of frame_pos
- *	
- *	The value of frame_pos is adjusted based on the value of select_pos.
- *	Therefore, this function is called after every update to the value of
- *	select_pos. It helps to handle the following 4 conditions.
+/** @brief Gets the length of a string of a node
+ *	@param str The string.
+ *	@param len The cached length of the string, or 0 if it is unknown.
+ *	@param max The width the string is clipped to.
+ *	@returns The length of the string, up to max.
  *
- *		1. Select arrow loops from bottom to top. 
- *		2. Select arrow loops from top to bottom.
- *		3. Select arrow moves downward beyond current frame.
- *		4. Select arrow moves upward beyond current frame.
+ *	Strings longer than max are clipped rather than scanned to their end, so
+ *	a long title never runs past its row.
  */
-static void apptree_adjust_frame_pos(void)
+static size_t apptree_string_len(const char *str, size_t len, size_t max)
 {
-	if (control.select_pos == 0) {
-		control.frame_pos = 0;
-	} else if (control.select_pos == (control.picture_height - 1)) {
-		control.frame_pos = control.picture_height - FRAME_HEIGHT;
-		
-		if(control.frame_pos < 0)
-			control.frame_pos = 0;
+	if (len || (str == NULL))
+		return len;
+	
+	while ((len < max) && str[len])
+		len++;
+	
+	return len;
+}
+
+/** @brief Prints the info of a pointed item
+ *	@param control The apptree session.
+ */
+static void apptree_print_info(struct apptree_control *control)
+{
+	struct apptree_iovec iov[3];
+	struct apptree_node *node;
+#if APPTREE_LAZY_NODES
+	const struct apptree_provider *provider = control->current->provider;
+#endif
+	
+	iov[0].base = "< ";
+	iov[0].len	= 2;
+	iov[2].base = " >";
+	iov[2].len	= 2;
+	
+#if APPTREE_LAZY_NODES
+	if (provider) {
+		if (provider->info && (control->picture_height > 0))
+			iov[1].base = provider->info(control->current, control->select_pos);
+		else
+			iov[1].base = control->current->info;
+		
+		iov[1].len = apptree_string_len(iov[1].base, 0, MAX_INFO_WIDTH);
+		apptree_putv(&control->io, iov, 3);
+		return;
+	}
+#endif
+
+	/* A node whose children have all been removed shows its own info */
+	if (control->picture_height == 0)
+		node = control->current;
+	else
+		node = control->current->children[control->select_pos];
+	
+	iov[1].base = node->info;
+	iov[1].len	= apptree_string_len(node->info, node->info_len,
+										MAX_INFO_WIDTH);
+	apptree_putv(&control->io, iov, 3);
+}
+
+/** @brief Gets the select arrow of an item
+ *	@param control The apptree session.
+ *	@param index Index of the item in the picture.
+ *	@returns The arrow if the item is pointed on and blanks if otherwise,
+ *	both of which are 4 characters long.
+ */
+static const char *apptree_get_arrow(struct apptree_control *control,
+										int index)
+{
+	if (index == control->select_pos)
+		return " -> ";
+	else
+		return "    ";
+}
+
+/** @brief Gets the selected marker of a node
+ *	@param parent The parent of the node.
+ *	@param child_index The position of the node as a child to its parent.
+ *	@returns The 4 character long marker, or NULL if the parent is Simple.
+ */
+static const char *apptree_get_marker(struct apptree_node *parent,
+										int child_index)
+{
+	bool selected;
+	
+	if (parent->mode == APPTREE_MODE_SIMPLE)
+		return NULL;
+	
+#if APPTREE_LAZY_NODES
+	if (parent->provider)
+		selected = parent->provider->selected &&
+					parent->provider->selected(parent, child_index);
+	else
+#endif
+	selected = apptree_is_selected(parent, child_index);
+	
+	return selected ? "[*] " : "[ ] ";
+}
+
+#if APPTREE_ROW_CACHE_SIZE
+/** @brief Formats the rows of the current node into the row cache
+ *	@param control The apptree session.
+ *	@returns The page holding the rows, or NULL if they do not fit into one.
+ *
+ *	The rows are sized up first, so that no page is evicted for a node which
+ *	does not fit. Otherwise the least recently shown page is reused.
+ */
+static struct apptree_row_page *apptree_build_row_page(
+									struct apptree_control *control)
+{
+	struct apptree_node *node = control->current;
+	struct apptree_row_page *page = &control->row_cache[0];
+	struct apptree_node *child;
+	char number[APPTREE_NUMBER_SIZE];
+	size_t size, prefix, len;
+	char *chars;
+	int i;
+	
+	prefix = (node->mode == APPTREE_MODE_SIMPLE) ? 4 : 8;
+	size = (node->num_child + 1) * sizeof(page->data[0]);
+	
+	for (i = 0; i < (int)node->num_child; i++) {
+		child = node->children[i];
+		size += prefix + apptree_format_dec(i + 1, 2, number) + 2 +
+				apptree_string_len(child->title, child->title_len,
+									MAX_TITLE_WIDTH);
+	}
+	
+	if (size > sizeof(page->data)) {
+		control->row_rejected			 = node;
+		control->row_rejected_generation = control->tree->generation;
+		control->row_rejected_version	 = node->rows_version;
+		return NULL;
+	}
+	
+	for (i = 1; i < APPTREE_ROW_CACHE_PAGES; i++)
+		if (control->row_cache[i].last_used < page->last_used)
+			page = &control->row_cache[i];
+	
+	chars = (char *)&page->data[node->num_child + 1];
+	size = 0;
+	
+	for (i = 0; i < (int)node->num_child; i++) {
+		child = node->children[i];
+		page->data[i] = size;
+		
+		/* The arrow and marker are filled in when the row is printed */
+		size += prefix;
+		
+		len = apptree_format_dec(i + 1, 2, number);
+		memcpy(&chars[size], number, len);
+		size += len;
+		chars[size++] = '.';
+		chars[size++] = ' ';
+		
+		len = apptree_string_len(child->title, child->title_len,
+									MAX_TITLE_WIDTH);
+		memcpy(&chars[size], child->title, len);
+		size += len;
+	}
+	
+	page->data[i]	 = size;
+	page->node		 = node;
+	page->generation = control->tree->generation;
+	page->version	 = node->rows_version;
+	
+	return page;
+}
+
+/** @brief Finds the formatted rows of the current node
+ *	@param control The apptree session.
+ *	@returns The page holding the rows, or NULL if they are not cached.
+ *
+ *	The rows of a node are formatted when it is first shown, and are then
+ *	reused until the page is evicted or the rows of the node change, as a
+ *	title of a child does. Lazy nodes are never cached.
+ */
+static struct apptree_row_page *apptree_find_row_page(
+									struct apptree_control *control)
+{
+	struct apptree_row_page *page = NULL;
+	unsigned int generation = control->tree->generation;
+	unsigned int version = control->current->rows_version;
+	int i;
+	
+#if APPTREE_LAZY_NODES
+	if (control->current->provider)
+		return NULL;
+#endif
+	
+	for (i = 0; (i < APPTREE_ROW_CACHE_PAGES) && (page == NULL); i++)
+		if ((control->row_cache[i].node == control->current) &&
+			(control->row_cache[i].generation == generation) &&
+			(control->row_cache[i].version == version))
+			page = &control->row_cache[i];
+	
+	if (page == NULL) {
+		if ((control->row_rejected == control->current) &&
+			(control->row_rejected_generation == generation) &&
+			(control->row_rejected_version == version))
+			return NULL;
+		
+		page = apptree_build_row_page(control);
+		if (page == NULL)
+			return NULL;
+	}
+	
+	page->last_used = ++control->row_clock;
+	return page;
+}
+
+/** @brief Prints a single row of the frame from the row cache
+ *	@param control The apptree session.
+ *	@param page The page holding the rows of the current node.
+ *	@param index Index of the item in the picture.
+ *
+ *	Only the arrow and marker are patched into the formatted row, which is
+ *	then written as a single segment.
+ */
+static void apptree_print_cached_row(struct apptree_control *control,
+										struct apptree_row_page *page,
+										int index)
+{
+	char *row = (char *)&page->data[control->current->num_child + 1] +
+				page->data[index];
+	const char *marker;
+	
+	memcpy(row, apptree_get_arrow(control, index), 4);
+	
+	marker = apptree_get_marker(control->current, index);
+	if (marker)
+		memcpy(&row[4], marker, 4);
+	
+	apptree_putn(&control->io, row, page->data[index + 1] - page->data[index]);
+}
+#endif
+
+/** @brief Outdates the cached rows of a node
+ *	@param tree The tree of the node.
+ *	@param node The node whose rows have changed.
+ *
+ *	Only the rows of the node are outdated, in the row cache of every session
+ *	showing the tree. Constant nodes keep no version, so all rows are outdated
+ *	for them instead.
+ */
+static void apptree_touch_rows(struct apptree_tree *tree,
+								struct apptree_node *node)
+{
+#if APPTREE_ROW_CACHE_SIZE
+	if (node->tree)
+		node->rows_version++;
+	else
+		tree->generation++;
+#else
+	(void)tree;
+	(void)node;
+#endif
+}
+
+/** @brief Prints a single row of the frame
+ *	@param control The apptree session.
+ *	@param index Index of the item in the picture.
+ *
+ *	The pieces of the row are handed over as a single gather write. Rows which
+ *	fall beyond the end of the picture are left blank.
+ */
+static void apptree_print_frame_row(struct apptree_control *control,
+									int index)
+{
+	struct apptree_iovec iov[4];
+	char number[APPTREE_NUMBER_SIZE + 2];
+	const char *marker;
+	int count = 0;
+	int len;
+#if APPTREE_ROW_CACHE_SIZE
+	struct apptree_row_page *page;
+#endif
+	
+	if (index >= control->picture_height)
+		return;
+	
+#if APPTREE_ROW_CACHE_SIZE
+	page = apptree_find_row_page(control);
+	if (page) {
+		apptree_print_cached_row(control, page, index);
+		return;
+	}
+#endif
+	
+	iov[count].base	  = apptree_get_arrow(control, index);
+	iov[count++].len  = 4;
+	
+	marker = apptree_get_marker(control->current, index);
+	if (marker) {
+		iov[count].base	  = marker;
+		iov[count++].len  = 4;
+	}
+	
+	len = apptree_format_dec(index + 1, 2, number);
+	number[len++] = '.';
+	number[len++] = ' ';
+	iov[count].base	  = number;
+	iov[count++].len  = len;
+	
+	iov[count].base	  = apptree_picture_title(control, index);
+	iov[count++].len  = apptree_picture_title_len(control, index);
+	
+	apptree_putv(&control->io, iov, count);
+}
+
+/**	@brief Prints the title of the current parent node
+ *	@param control The apptree session.
+ */
+static void apptree_print_title(struct apptree_control *control)
+{
+	struct apptree_node *node = control->current;
+	
+	apptree_putn(&control->io, node->title,
+					apptree_string_len(node->title, node->title_len,
+										MAX_TITLE_WIDTH));
+}
+
+/** @brief Prints a row of the menu
+ *	@param control The apptree session.
+ *	@param row The row to be printed, counted from the top of the terminal.
+ *
+ *	The menu consists of the title, frame, info and keybindings in that order,
+ *	separated by blank rows. The line ending is not printed.
+ */
+static void apptree_print_row(struct apptree_control *control, int row)
+{
+	if (row == ROW_TITLE)
+		apptree_print_title(control);
+	else if ((row >= ROW_FRAME) && (row < (ROW_FRAME + FRAME_HEIGHT)))
+		apptree_print_frame_row(control, control->frame_pos + row - ROW_FRAME);
+	else if (row == ROW_INFO)
+		apptree_print_info(control);
+	else if (row == ROW_KEYBINDINGS)
+		apptree_print_keybindings(control);
+}
+
+/** @brief Prints a row of the menu as a line
+ *	@param control The apptree session.
+ *	@param row The row to be printed, counted from the top of the terminal.
+ *
+ *	Each row is handed to the io as a separate line, which either streams it
+ *	to the output or, in diff render mode, only sends it if it has changed
+ *	since the last menu was printed.
+ */
+static void apptree_print_line(struct apptree_control *control, int row)
+{
+	apptree_io_begin_line(&control->io, row);
+	apptree_print_row(control, row);
+	apptree_io_end_line(&control->io);
+}
+
+/** @brief Scrolls the frame shown on the display to frame_pos
+ *	@param control The apptree session.
+ *
+ *	If the last menu showed the same node, the frame is scrolled by the number
+ *	of rows frame_pos has moved since, so that the rows which are still in the
+ *	frame do not have to be written again. This is called right before the
+ *	first row of a menu is printed.
+ */
+static void apptree_scroll_frame(struct apptree_control *control)
+{
+#if APPTREE_DIFF_RENDER
+	if (control->shown_node == control->current)
+		apptree_io_scroll(&control->io, ROW_FRAME, FRAME_HEIGHT,
+							control->frame_pos - control->shown_frame_pos);
+	
+	control->shown_node		 = control->current;
+	control->shown_frame_pos = control->frame_pos;
+#else
+	(void)control;
+#endif
+}
+
+/**	@brief Prints the menu.
+ *	@param control The apptree session.
+ *
+ *	In incremental render mode, the menu is only scheduled here and is printed
+ *	by apptree_render_step. A menu which is still being rendered is restarted
+ *	from the top, so outdated rows are never completed.
+ */
+static void apptree_print_menu(struct apptree_control *control)
+{
+	int row;
+	
+	if (control->incremental) {
+		control->render_row = 0;
+		return;
+	}
+	
+	apptree_scroll_frame(control);
+	for (row = 0; row < TERMINAL_HEIGHT; row++)
+		apptree_print_line(control, row);
+	
+	apptree_io_flush_display(&control->io);
+}
+
+/** @brief Prints the menu after it has changed
+ *	@param control The apptree session.
+ *
+ *	With a frame limit, the menu is only marked as changed, to be printed by
+ *	apptree_tick. During an update, it is left to apptree_commit_update.
+ */
+static void apptree_schedule_menu(struct apptree_control *control)
+{
+	if ((control->frame_interval > 0) || (control->update_depth > 0)) {
+		control->redraw = true;
+		return;
+	}
+	
+	control->redraw = false;
+	apptree_print_menu(control);
+}
+
+/** @}*/
+
+/* -------------------------------------------------------------------------- */
+/** @name Setup Functions
+ *	Handles node creation. Before any nodes can be added into the tree, the
+ *	initialization function has to be called.
+ */
+/** @{*/
+
+/** @brief Checks if a node is attached to the tree
+ *	@param tree The tree.
+ *	@param node The node, which may be NULL.
+ *	@returns 0 if yes and -1 if otherwise
+ *	
+ *	A node is attached to the tree if it has the master node as its encestor.
+ *	Every node records the tree it was attached to when it was created, so
+ *	this takes constant time however deep the node is.
+ */
+static int apptree_validate_node(struct apptree_tree *tree,
+									struct apptree_node *node)
+{
+	if ((node == NULL) || (node->tree != tree))
+		return -1;
+	else
+		return 0;
+}
+
+/** @brief Allocates a node and attaches it to a parent
+ *	@param tree The tree of the parent.
+ *	@param parent Parent node to attach the new node to, which must be valid.
+ *	@param title Title message of the new node.
+ *	@param info Info message of the new node.
+ *	@param mode Mode of the node.
+ *	@param selected Indicated whether this node should be set as selected.
+ *	@param function Function to bind to this node.
+ *	@returns The new node if successful and NULL if otherwise.
+ */
+static struct apptree_node *apptree_attach_node(struct apptree_tree *tree,
+		struct apptree_node *parent,
+		char *title,
+		char *info,
+		enum apptree_mode mode,
+		bool selected,
+		void (*function)(struct apptree_node *parent, int child_idx))
+{
+	struct apptree_node *node;
+	
+	if (parent->num_child == APPTREE_MAX_CHILDREN)
+		return NULL;
+	
+	node = apptree_alloc_node(tree);
+	if (node == NULL)
+		return NULL;
+	
+	node->parent = parent;
+	node->tree	 = tree;
+	
+	node->last_child   = NULL;
+	node->prev_sibling = parent->last_child;
+	parent->last_child = node;
+	tree->num_nodes++;
+	
+	/* The children of a frozen tree are counted again once it is rebuilt */
+	if (!tree->frozen)
+		parent->num_child++;
+	
+	node->title	 	= title;
+	node->info	 	= info;
+	node->title_len	= apptree_string_len(title, 0, MAX_TITLE_WIDTH);
+	node->info_len	= apptree_string_len(info, 0, MAX_INFO_WIDTH);
+	node->mode		= mode;
+	node->num_child = 0;
+	node->state		= &node->state_storage;
+	node->state->selected = selected;
+	node->function	= function;
+	node->children	= NULL;
+	
+	return node;
+}
+
+/** @brief Creates a node and attaches it to the tree
+ *	@param control The apptree session.
+ *	@param new_node Handle for holding the new node.
+ *	@param parent Parent node to attach the new node to.
+ *	@param title Title message of the new node.
+ *	@param info Info message of the new node.
+ *	@param mode Mode of the node.
+ *	@param selected Indicated whether this node should be set as selected.
+ *	@param function Function to bind to this node.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	This function allocates memory, either from the heap or from the pool
+ *	supplied to apptree_init_pool, to create a new node and subsequently
+ *	attaches it to the tree of the session. This function will fail under
+ *	these circumstances:
+ *	
+ *		1. The tree is frozen, as apptree_enable has been called on any
+ *		   session showing it, and no update is begun on this session
+ *		   (see apptree_begin_update).
+ *		2. The parent function is an end node.
+ *		3. The tree is constant (see apptree_init_const).
+ *
+ *	@note The children of a node which is not Simple (either Single Selection
+ *	or Multi Selection) is automatically set as an end node. An end node will
+ *	not be able to have children. Also, if a parent node is set to Single
+ *	Selection, only one of its children can be set as selected.
+ */
+int apptree_create_node(struct apptree_control *control,
+		struct apptree_node **new_node,
+		struct apptree_node *parent,
+		char *title,
+		char *info,
+		enum apptree_mode mode,
+		bool selected,
+		void (*function)(struct apptree_node *parent, int child_idx))
+{	
+	struct apptree_tree *tree = control->tree;
+	struct apptree_node *node;
+	
+	if (apptree_open_structure(control))
+		return -1;
+	
+	if (apptree_validate_node(tree, parent) || apptree_is_end(parent))
+		return -1;
+	
+	node = apptree_attach_node(tree, parent, title, info,
+								mode, selected, function);
+	if (node == NULL)
+		return -1;
+
+	*new_node = node;
+	
+	return 0;
+}
+
+/** @brief Checks an entry of a subtree specification
+ *	@param parent The node the subtree is attached to.
+ *	@param spec The specification.
+ *	@param index Position of the entry in spec.
+ *	@returns 0 if the entry can be attached and -1 if otherwise.
+ *
+ *	An entry can only refer to an entry before it, and its parent must not be
+ *	an end node. The children of a node which is not Simple are end nodes.
+ */
+static int apptree_validate_spec(struct apptree_node *parent,
+									const struct apptree_node_spec *spec,
+									int index)
+{
+	int p = spec[index].parent;
+	int q;
+	
+	if ((p < -1) || (p >= index))
+		return -1;
+	
+	if (p == -1)
+		return apptree_is_end(parent) ? -1 : 0;
+	
+	q = spec[p].parent;
+	if (q == -1)
+		return (parent->mode != APPTREE_MODE_SIMPLE) ? -1 : 0;
+	
+	return (spec[q].mode != APPTREE_MODE_SIMPLE) ? -1 : 0;
+}
+
+/** @brief Takes back the nodes of a subtree which could not be attached
+ *	@param tree The tree.
+ *	@param nodes The handles of the nodes, or NULL if they are taken from a
+ *	pool.
+ *	@param first The first node taken from the pool, if nodes is NULL.
+ *	@param count Number of nodes attached.
+ *
+ *	The nodes are taken back in the reverse order they were attached, so each
+ *	one heads the chain of children of its parent, and the pool hands them
+ *	out again.
+ */
+static void apptree_undo_subtree(struct apptree_tree *tree,
+									struct apptree_node **nodes,
+									struct apptree_node *first,
+									int count)
+{
+	struct apptree_node *node;
+	
+	while (count-- > 0) {
+		node = nodes ? nodes[count] : &first[count];
+		
+		node->parent->last_child = node->prev_sibling;
+		if (!tree->frozen)
+			node->parent->num_child--;
+		tree->num_nodes--;
+		
+		if (tree->pool)
+			tree->pool->used--;
+		else
+			free(node);
+	}
+}
+
+/** @brief Creates a whole subtree and attaches it to the tree
+ *	@param control The apptree session.
+ *	@param nodes Array of count handles for holding the new nodes. It may be
+ *	NULL if the nodes are taken from a pool.
+ *	@param parent Parent node to attach the subtree to.
+ *	@param spec The nodes of the subtree in order. The parent of every entry
+ *	is given as the position of an earlier entry, or -1 for parent.
+ *	@param count Number of entries in spec.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	Works like calling apptree_create_node once per entry, except that the
+ *	parent is only validated once and the whole specification is checked
+ *	before any node is created. The specification may be a constant table,
+ *	such as one generated for a large configuration menu. When the nodes are
+ *	taken from a pool, the pool is also checked to hold all of them up front.
+ *	Either the whole subtree is attached or nothing is, as the nodes created
+ *	so far are taken back should a node run out of children or the heap run
+ *	out halfway through.
+ */
+int apptree_create_subtree(struct apptree_control *control,
+							struct apptree_node **nodes,
+							struct apptree_node *parent,
+							const struct apptree_node_spec *spec,
+							int count)
+{
+	struct apptree_tree *tree = control->tree;
+	struct apptree_node *node;
+	struct apptree_node *first;
+	int i;
+	
+	if ((spec == NULL) || (count < 0) || apptree_open_structure(control))
+		return -1;
+	
+	/* Entries refer to earlier entries through the handles, or, from a pool,
+	 * by their offset from the first node handed out.
+	 */
+	first = tree->pool ? &tree->pool->nodes[tree->pool->used] : NULL;
+	if ((nodes == NULL) && (first == NULL))
+		return -1;
+	
+	if (apptree_validate_node(tree, parent))
+		return -1;
+	
+	for (i = 0; i < count; i++)
+		if (apptree_validate_spec(parent, spec, i))
+			return -1;
+	
+	if (tree->pool && ((tree->pool->size - tree->pool->used) < count))
+		return -1;
+	
+	for (i = 0; i < count; i++) {
+		if (spec[i].parent == -1)
+			node = parent;
+		else if (nodes)
+			node = nodes[spec[i].parent];
+		else
+			node = &first[spec[i].parent];
+		
+		node = apptree_attach_node(tree, node, spec[i].title, spec[i].info,
+									spec[i].mode, spec[i].selected,
+									spec[i].function);
+		if (node == NULL) {
+			apptree_undo_subtree(tree, nodes, first, i);
+			return -1;
+		}
+		
+		if (nodes)
+			nodes[i] = node;
+	}
+	
+	return 0;
+}
+
+/** @brief Creates a lazy node and attaches it to the tree
+ *	@param control The apptree session.
+ *	@param new_node Handle for holding the new node.
+ *	@param parent Parent node to attach the new node to.
+ *	@param title Title message of the new node.
+ *	@param info Info message of the new node.
+ *	@param mode Mode of the new node. If it is not Simple, the selected
+ *	markers of the items are taken from the provider.
+ *	@param provider Provider of the items of the new node.
+ *	@param function Function called when the new node is selected while it
+ *	has no items.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	The items of a lazy node are not nodes of the tree. Instead, they are
+ *	counted and resolved through the provider whenever the lazy node is
+ *	shown, and only the titles of the items within the frame are kept. This
+ *	suits large or live lists such as logs, file listings or sensor readings,
+ *	as no memory is spent per item and nothing has to be rebuilt when the
+ *	items change. Call apptree_refresh_node after the items of a lazy node
+ *	have changed outside of its provider. A lazy node is always an end node.
+ *	It fails under the same circumstances as apptree_create_node.
+ *
+ *	@note The apptree has to be compiled with APPTREE_LAZY_NODES set to 1 for
+ *	lazy nodes to be available.
+ */
+int apptree_create_lazy_node(struct apptree_control *control,
+		struct apptree_node **new_node,
+		struct apptree_node *parent,
+		char *title,
+		char *info,
+		enum apptree_mode mode,
+		const struct apptree_provider *provider,
+		void (*function)(struct apptree_node *parent, int child_idx))
+{
+#if APPTREE_LAZY_NODES
+	if ((provider == NULL) || (provider->count == NULL) ||
+		(provider->title == NULL))
+		return -1;
+	
+	if (apptree_create_node(control, new_node, parent, title, info,
+							mode, false, function))
+		return -1;
+	
+	(*new_node)->provider = provider;
+	
+	return 0;
+#else
+	(void)control;
+	(void)new_node;
+	(void)parent;
+	(void)title;
+	(void)info;
+	(void)mode;
+	(void)provider;
+	(void)function;
+	return -1;
+#endif
+}
+
+/** @brief Indexes the children of a node and its descendants
+ *	@param node The node to be indexed.
+ *	@param slot The first free slot in the index.
+ *	@returns The first free slot after the node and its descendants.
+ *
+ *	The chain of children runs from the last child attached to the first, so
+ *	the children are laid out from the end of their slots.
+ */
+static struct apptree_node **apptree_index_node(struct apptree_node *node,
+												struct apptree_node **slot)
+{
+	struct apptree_node *child;
+	int i = node->num_child;
+	
+	node->children = slot;
+	slot += node->num_child;
+	
+	for (child = node->last_child; child; child = child->prev_sibling)
+		node->children[--i] = child;
+	
+	for (i = 0; i < node->num_child; i++)
+		slot = apptree_index_node(node->children[i], slot);
+	
+	return slot;
+}
+
+/** @brief Builds the child index of the tree
+ *	@param tree The tree.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	The children of every node are laid out in a single contiguous array so
+ *	that a child can be looked up by its position in constant time. Every node
+ *	apart from the master is a child of exactly one node, so the array holds
+ *	one slot less than the number of nodes in the tree.
+ */
+static int apptree_build_index(struct apptree_tree *tree)
+{
+	struct apptree_node **temp;
+	
+	if (tree->pool) {
+		apptree_index_node(tree->master, tree->pool->index);
+		return 0;
+	}
+	
+#if APPTREE_STATS
+	tree->allocations++;
+#endif
+	temp = realloc(tree->index,
+				(tree->num_nodes - 1) * sizeof(struct apptree_node *));
+	if ((temp == NULL) && (tree->num_nodes > 1))
+		return -1;
+	
+	tree->index = temp;
+	apptree_index_node(tree->master, tree->index);
+	return 0;
+}
+
+/** @brief Checks whether a node is an end node
+ *	@param node The node.
+ *	@returns true if the node cannot have children and false if otherwise.
+ *
+ *	The children of a node which is not Simple are end nodes, and so are lazy
+ *	nodes, whose items are not nodes.
+ */
+static bool apptree_is_end(const struct apptree_node *node)
+{
+	if (node->parent && (node->parent->mode != APPTREE_MODE_SIMPLE))
+		return true;
+	
+#if APPTREE_LAZY_NODES
+	if (node->provider)
+		return true;
+#endif
+	
+	return false;
+}
+
+/** @brief Gets the state of a Single or Multi Selection node with children
+ *	@param node The node.
+ *	@returns The state, or NULL if the node is Simple or its selections are
+ *	not tracked, as it has no children or the tree is not frozen yet.
+ */
+static struct apptree_parent_state *apptree_get_parent_state(
+											const struct apptree_node *node)
+{
+	if ((node->mode == APPTREE_MODE_SIMPLE) ||
+		(node->state == &node->state_storage))
+		return NULL;
+	
+	return (struct apptree_parent_state *)node->state;
+}
+
+/** @brief Counts the selection words needed by a node and its descendants
+ *	@param node The node.
+ *	@param parents Handle for adding up the parent states needed.
+ *	@returns The number of words.
+ */
+static int apptree_count_selection_words(struct apptree_node *node,
+											int *parents)
+{
+	int words = 0;
+	int i;
+	
+	if ((node->mode != APPTREE_MODE_SIMPLE) && (node->num_child > 0))
+		(*parents)++;
+	
+	if (node->mode == APPTREE_MODE_MULTI_SELECTION)
+		words = APPTREE_SELECTION_WORDS(node->num_child);
+	
+	for (i = 0; i < (int)node->num_child; i++)
+		words += apptree_count_selection_words(node->children[i], parents);
+	
+	return words;
+}
+
+/** @brief Tracks the selections of a node and its descendants
+ *	@param node The node to be tracked.
+ *	@param words Handle to the first free word of the selection storage, or
+ *	NULL if every Multi Selection node already has its bitset.
+ *	@param parents Handle to the first free parent state, or NULL if every
+ *	Single and Multi Selection node already has one.
+ *
+ *	Every Single and Multi Selection node with children moves its state into
+ *	a parent state. The selected child of every Single Selection node is
+ *	looked up once, and every child keeps its position, so that selections
+ *	can later be changed without scanning the children. If more than one
+ *	child was set as selected, only the last one is kept. The initial
+ *	selections of the children of every Multi Selection node are packed into
+ *	its bitset.
+ */
+static void apptree_track_selection(struct apptree_node *node,
+									uint32_t **words,
+									struct apptree_parent_state **parents)
+{
+	struct apptree_parent_state *record = NULL;
+	struct apptree_node *child;
+	int size;
+	int i;
+	
+	if ((node->mode != APPTREE_MODE_SIMPLE) && (node->num_child > 0)) {
+		record = apptree_get_parent_state(node);
+		if (record == NULL) {
+			record = (*parents)++;
+			record->state	  = node->state_storage;
+			record->selection = NULL;
+			node->state		  = &record->state;
+		}
+		
+		record->selected_child = -1;
+	}
+	
+	if (record && (node->mode == APPTREE_MODE_MULTI_SELECTION)) {
+		size = APPTREE_SELECTION_WORDS(node->num_child);
+		if (record->selection == NULL) {
+			record->selection = *words;
+			*words += size;
+		}
+		
+		memset(record->selection, 0, size * sizeof(uint32_t));
+	}
+	
+	for (i = 0; i < (int)node->num_child; i++) {
+		child = node->children[i];
+		child->state->child_index = i;
+		
+		if ((node->mode == APPTREE_MODE_SINGLE_SELECTION) &&
+			child->state->selected) {
+			if (record->selected_child >= 0)
+				node->children[record->selected_child]->state->selected
+					= false;
+			
+			record->selected_child = i;
+		}
+		
+		if ((node->mode == APPTREE_MODE_MULTI_SELECTION) &&
+			child->state->selected)
+			record->selection[i / 32] |= (uint32_t)1 << (i % 32);
+		
+		apptree_track_selection(child, words, parents);
+	}
+}
+
+/** @brief Builds the selection bitsets of the tree
+ *	@param tree The tree, which must be indexed.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	The bitsets of every Multi Selection node are laid out in a single array,
+ *	and the parent states of every Single and Multi Selection node with
+ *	children in another, both taken from the pool or the heap, and filled
+ *	with the initial selections.
+ */
+static int apptree_build_selection(struct apptree_tree *tree)
+{
+	int parents = 0;
+	int words = apptree_count_selection_words(tree->master, &parents);
+	struct apptree_parent_state *records;
+	uint32_t *selection;
+	
+	if (tree->pool) {
+		if (words > tree->pool->selection_size)
+			return -1;
+		
+		selection = tree->pool->selection;
+		records	  = tree->pool->parents;
+		apptree_track_selection(tree->master, &selection, &records);
+		return 0;
+	}
+	
+#if APPTREE_STATS
+	tree->allocations += 2;
+#endif
+	selection = realloc(tree->selection, words * sizeof(uint32_t));
+	if ((selection == NULL) && (words > 0))
+		return -1;
+	
+	tree->selection = selection;
+	
+	records = realloc(tree->parents,
+						parents * sizeof(struct apptree_parent_state));
+	if ((records == NULL) && (parents > 0))
+		return -1;
+	
+	tree->parents = records;
+	apptree_track_selection(tree->master, &selection, &records);
+	return 0;
+}
+
+#if APPTREE_TYPE_AHEAD
+/** @brief Compares two strings without regard to case
+ *	@param a The first string, which may be NULL for an empty string.
+ *	@param b The second string, which may be NULL for an empty string.
+ *	@param len The maximum number of characters to be compared.
+ *	@returns A negative value, 0 or a positive value if a sorts before, with
+ *	or after b respectively.
+ */
+static int apptree_compare_text(const char *a, const char *b, size_t len)
+{
+	size_t i;
+	int ca, cb;
+	
+	if (a == NULL)
+		a = "";
+	if (b == NULL)
+		b = "";
+	
+	for (i = 0; i < len; i++) {
+		ca = (unsigned char)a[i];
+		cb = (unsigned char)b[i];
+		
+		if ((ca >= 'A') && (ca <= 'Z'))
+			ca += 'a' - 'A';
+		if ((cb >= 'A') && (cb <= 'Z'))
+			cb += 'a' - 'A';
+		
+		if ((ca != cb) || (ca == '\0'))
+			return ca - cb;
+	}
+	
+	return 0;
+}
+
+/** @brief Sorts the children of a node by title
+ *	@param node The node.
+ *	@param sorted Array receiving the positions of the children in order.
+ *
+ *	Children with the same title are kept in the order they are shown. A
+ *	shell sort is used, which needs neither recursion nor extra memory.
+ */
+static void apptree_sort_children(struct apptree_node *node, int *sorted)
+{
+	int n = node->num_child;
+	int gap, i, j, pos, cmp;
+	
+	for (i = 0; i < n; i++)
+		sorted[i] = i;
+	
+	for (gap = n / 2; gap > 0; gap /= 2) {
+		for (i = gap; i < n; i++) {
+			pos = sorted[i];
+			
+			for (j = i; j >= gap; j -= gap) {
+				cmp = apptree_compare_text(node->children[sorted[j - gap]]->title,
+											node->children[pos]->title,
+											(size_t)-1);
+				if ((cmp < 0) || ((cmp == 0) && (sorted[j - gap] < pos)))
+					break;
+				
+				sorted[j] = sorted[j - gap];
+			}
+			
+			sorted[j] = pos;
+		}
+	}
+}
+
+/** @brief Sorts the children of a node and its descendants
+ *	@param node The node to be sorted.
+ *	@param slot The first free slot in the sorted array.
+ *	@returns The first free slot after the node and its descendants.
+ *
+ *	The nodes are visited in the same order as by apptree_index_node, so the
+ *	sorted children of a node sit at the same offset as its child index.
+ */
+static int *apptree_sort_node(struct apptree_node *node, int *slot)
+{
+	int i;
+	
+	apptree_sort_children(node, slot);
+	slot += node->num_child;
+	
+	for (i = 0; i < (int)node->num_child; i++)
+		slot = apptree_sort_node(node->children[i], slot);
+	
+	return slot;
+}
+
+/** @brief Builds the children of every node sorted by title
+ *	@param tree The tree, which must already be indexed.
+ *	@returns 0 if successful and -1 if otherwise.
+ */
+static int apptree_build_sorted(struct apptree_tree *tree)
+{
+	int *temp;
+	
+	if (tree->pool) {
+		tree->sorted = tree->pool->sorted;
+		apptree_sort_node(tree->master, tree->sorted);
+		return 0;
+	}
+	
+#if APPTREE_STATS
+	tree->allocations++;
+#endif
+	temp = realloc(tree->sorted, (tree->num_nodes - 1) * sizeof(int));
+	if ((temp == NULL) && (tree->num_nodes > 1))
+		return -1;
+	
+	tree->sorted = temp;
+	apptree_sort_node(tree->master, tree->sorted);
+	return 0;
+}
+
+/** @brief Gets the sorted children of a node
+ *	@param tree The tree.
+ *	@param node The node.
+ *	@returns The positions of the children sorted by title, or NULL if the
+ *	tree is not sorted.
+ */
+static int *apptree_sorted_children(struct apptree_tree *tree,
+									struct apptree_node *node)
+{
+	struct apptree_node **base;
+	
+	if ((tree->sorted == NULL) || (node->children == NULL))
+		return NULL;
+	
+	base = tree->pool ? tree->pool->index : tree->index;
+	return &tree->sorted[node->children - base];
+}
+
+/** @brief Finds a child by the start of its title
+ *	@param tree The tree.
+ *	@param node The parent node.
+ *	@param prefix The start of the title, which is not terminated.
+ *	@param len The number of characters in prefix.
+ *	@returns The position of the first child in alphabetical order whose
+ *	title starts with prefix, or -1 if there is none.
+ *
+ *	The sorted children are searched in logarithmic time. Constant trees are
+ *	not sorted, so their children are searched in the order they are shown.
+ */
+static int apptree_find_prefix(struct apptree_tree *tree,
+								struct apptree_node *node,
+								const char *prefix, int len)
+{
+	int *sorted = apptree_sorted_children(tree, node);
+	int low = 0, high = node->num_child, mid;
+	
+	if (sorted == NULL) {
+		for (mid = 0; mid < high; mid++)
+			if (!apptree_compare_text(node->children[mid]->title, prefix, len))
+				return mid;
+		return -1;
+	}
+	
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (apptree_compare_text(node->children[sorted[mid]]->title,
+									prefix, len) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	
+	if ((low < (int)node->num_child) &&
+		!apptree_compare_text(node->children[sorted[low]]->title, prefix, len))
+		return sorted[low];
+	
+	return -1;
+}
+#endif
+
+/** @brief Enables the apptree
+ *	@param control The apptree session.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	This function is called at the end of the setup phase (after all nodes have
+ *	been added. It enables the apptree and prints the menu with the master node
+ *	as the current node. The tree is also frozen to prevent changes in its
+ *	structure, which allows the child index to be built once here. Sessions
+ *	sharing a frozen tree reuse its child index as it is.
+ */
+int apptree_enable(struct apptree_control *control)
+{
+	if (control->tree == NULL)
+		return -1;
+	
+	if (control->keys == NULL)
+		return -1;
+	
+	apptree_build_key_map(control);
+	
+	if (!control->tree->frozen) {
+		if (apptree_build_index(control->tree))
+			return -1;
+		
+		if (apptree_build_selection(control->tree))
+			return -1;
+		
+#if APPTREE_TYPE_AHEAD
+		if (apptree_build_sorted(control->tree))
+			return -1;
+#endif
+		
+		control->tree->frozen = true;
+	}
+	
+	control->current = control->tree->master;
+	control->enabled = true;
+#if APPTREE_PATH_DEPTH
+	control->path_len = 0;
+#endif
+	
+	apptree_populate_picture(control);
+	apptree_print_menu(control);
+	
+	return 0;
+}
+
+/** @brief Refreshes a node after it has changed
+ *	@param control The apptree session.
+ *	@param node The node that has changed.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	The cached rows of the node are outdated and its children are sorted
+ *	again, so that a changed title of a child shows and is found by
+ *	type-ahead. If the node is currently shown, its children are also
+ *	counted again and the menu is printed. Nothing is printed otherwise, as
+ *	the node is looked up again when it is next shown. This is mostly useful
+ *	for lazy nodes, whose items may change at any time. Each session showing
+ *	the node has to be refreshed on its own.
+ */
+int apptree_refresh_node(struct apptree_control *control,
+							struct apptree_node *node)
+{
+	if (!control->enabled)
+		return -1;
+	
+	apptree_touch_rows(control->tree, node);
+	
+	/* The child index is rebuilt once the update is committed */
+	if (control->update_structure) {
+		if (node == control->current)
+			control->redraw = true;
+		return 0;
+	}
+	
+#if APPTREE_TYPE_AHEAD
+	if (apptree_sorted_children(control->tree, node))
+		apptree_sort_children(node, apptree_sorted_children(control->tree,
+															node));
+#endif
+	
+	if (node != control->current)
+		return 0;
+	
+	apptree_refresh_picture(control);
+	apptree_schedule_menu(control);
+	
+	return 0;
+}
+
+/** @brief Gets the selected child of a Single Selection node
+ *	@param parent The Single Selection node.
+ *	@returns The position of the selected child, or -1 if there is none.
+ *
+ *	The selected child is tracked by the parent, so this does not scan the
+ *	children. It is only valid once the tree is frozen by apptree_enable, or
+ *	for a constant tree.
+ */
+int apptree_get_selected(const struct apptree_node *parent)
+{
+	struct apptree_parent_state *record;
+	
+	if ((parent == NULL) || (parent->mode != APPTREE_MODE_SINGLE_SELECTION))
+		return -1;
+	
+	record = apptree_get_parent_state(parent);
+	return record ? record->selected_child : -1;
+}
+
+/** @}*/
+
+
+/* -------------------------------------------------------------------------- */
+/** @name Selection Functions
+ *	Reads and changes the selections of the children of a node in bulk. The
+ *	children of a Multi Selection node are kept as a packed bitset in the
+ *	parent, so a whole set of choices can be saved to and restored from
+ *	non-volatile memory in a single copy. These functions are only valid once
+ *	the tree is frozen by apptree_enable, or for a constant tree. Call
+ *	apptree_refresh_node on the parent to show a change made here.
+ */
+/** @{*/
+
+/** @brief Checks whether a child is selected
+ *	@param parent The parent node.
+ *	@param child_index The position of the child.
+ *	@returns true if the child is selected and false if otherwise.
+ */
+bool apptree_is_selected(const struct apptree_node *parent, int child_index)
+{
+	struct apptree_parent_state *record;
+	
+	if ((parent == NULL) || (child_index < 0) ||
+		(child_index >= (int)parent->num_child))
+		return false;
+	
+	record = apptree_get_parent_state(parent);
+	
+	switch (parent->mode)
+	{
+	case APPTREE_MODE_SINGLE_SELECTION:
+		return record && (record->selected_child == child_index);
+		
+	case APPTREE_MODE_MULTI_SELECTION:
+		return record && ((record->selection[child_index / 32] >>
+							(child_index % 32)) & 1);
+		
+	default:
+		return parent->children[child_index]->state->selected;
+	}
+}
+
+/** @brief Gets the selections of the children of a Multi Selection node
+ *	@param parent The Multi Selection node.
+ *	@param mask Buffer for the bitset, or NULL to only get its size.
+ *	@param words Number of words in mask.
+ *	@returns The number of words in the bitset of the parent, which is
+ *	APPTREE_SELECTION_WORDS of its number of children, or -1 if the parent
+ *	is not Multi Selection.
+ *
+ *	Bit i % 32 of word i / 32 is set if child i is selected. At most words
+ *	words are copied into mask.
+ */
+int apptree_get_selection_mask(const struct apptree_node *parent,
+								uint32_t *mask, int words)
+{
+	struct apptree_parent_state *record;
+	int size;
+	
+	if ((parent == NULL) || (parent->mode != APPTREE_MODE_MULTI_SELECTION))
+		return -1;
+	
+	size = APPTREE_SELECTION_WORDS(parent->num_child);
+	if (mask == NULL)
+		return size;
+	
+	if (words > size)
+		words = size;
+	
+	if (words > 0) {
+		record = apptree_get_parent_state(parent);
+		if (record == NULL)
+			return -1;
+		
+		memcpy(mask, record->selection, words * sizeof(uint32_t));
+	}
+	
+	return size;
+}
+
+/** @brief Clears the bits of a bitset beyond the children of a node
+ *	@param parent The Multi Selection node.
+ *	@param record The state of the node.
+ */
+static void apptree_trim_selection(struct apptree_node *parent,
+									struct apptree_parent_state *record)
+{
+	int used = parent->num_child % 32;
+	
+	if (used)
+		record->selection[parent->num_child / 32] &=
+			((uint32_t)1 << used) - 1;
+}
+
+/** @brief Sets the selections of the children of a Multi Selection node
+ *	@param parent The Multi Selection node.
+ *	@param mask The bitset, laid out as with apptree_get_selection_mask.
+ *	@param words Number of words in mask. Any children beyond them are
+ *	cleared, and any bits beyond the children are ignored.
+ *	@returns 0 if successful and -1 if otherwise.
+ */
+int apptree_set_selection_mask(struct apptree_node *parent,
+								const uint32_t *mask, int words)
+{
+	struct apptree_parent_state *record;
+	int size;
+	
+	if ((parent == NULL) || (mask == NULL) || (words < 0) ||
+		(parent->mode != APPTREE_MODE_MULTI_SELECTION))
+		return -1;
+	
+	record = apptree_get_parent_state(parent);
+	if (record == NULL)
+		return (parent->num_child == 0) ? 0 : -1;
+	
+	size = APPTREE_SELECTION_WORDS(parent->num_child);
+	if (words > size)
+		words = size;
+	
+	memcpy(record->selection, mask, words * sizeof(uint32_t));
+	memset(&record->selection[words], 0, (size - words) * sizeof(uint32_t));
+	apptree_trim_selection(parent, record);
+	
+	return 0;
+}
+
+/** @brief Selects every child of a Multi Selection node
+ *	@param parent The Multi Selection node.
+ *	@returns 0 if successful and -1 if otherwise.
+ */
+int apptree_select_all(struct apptree_node *parent)
+{
+	struct apptree_parent_state *record;
+	
+	if ((parent == NULL) || (parent->mode != APPTREE_MODE_MULTI_SELECTION))
+		return -1;
+	
+	record = apptree_get_parent_state(parent);
+	if (record == NULL)
+		return (parent->num_child == 0) ? 0 : -1;
+	
+	memset(record->selection, 0xff,
+			APPTREE_SELECTION_WORDS(parent->num_child) * sizeof(uint32_t));
+	apptree_trim_selection(parent, record);
+	
+	return 0;
+}
+
+/** @brief Clears every child of a Multi Selection node
+ *	@param parent The Multi Selection node.
+ *	@returns 0 if successful and -1 if otherwise.
+ */
+int apptree_clear_all(struct apptree_node *parent)
+{
+	struct apptree_parent_state *record;
+	
+	if ((parent == NULL) || (parent->mode != APPTREE_MODE_MULTI_SELECTION))
+		return -1;
+	
+	record = apptree_get_parent_state(parent);
+	if (record == NULL)
+		return (parent->num_child == 0) ? 0 : -1;
+	
+	memset(record->selection, 0,
+			APPTREE_SELECTION_WORDS(parent->num_child) * sizeof(uint32_t));
+	
+	return 0;
+}
+
+/** @}*/
+
+
+#if APPTREE_IMAGE
+/* -------------------------------------------------------------------------- */
+/** @name Image Functions
+ *	Imports and exports subtrees as images, which are flat arrays of nodes
+ *	with a string table and the selection bits. An image refers to nothing
+ *	outside of itself, so it can be kept in internal or memory mapped flash,
+ *	or sent to another device. An image is imported into RAM, with a node of
+ *	the tree created for every node of the image, and only its strings are
+ *	used in place, so the image has to be kept for as long as the tree is.
+ *	The nodes of an image are not read in place, as they hold offsets where
+ *	every session walks struct apptree_node pointers. A tree which takes no
+ *	RAM for its nodes is declared with APPTREE_CONST_NODE instead.
+ */
+/** @{*/
+
+/** @brief Checks a string entry of a tree image
+ *	@param header The image.
+ *	@param offset Offset of the entry in the string table, or
+ *	APPTREE_IMAGE_NONE.
+ *	@param max The width the string is clipped to.
+ *	@returns 0 if the entry is valid and -1 if otherwise.
+ */
+static int apptree_validate_string(const struct apptree_image_header *header,
+									uint32_t offset, size_t max)
+{
+	const struct apptree_image_string *entry;
+	
+	if (offset == APPTREE_IMAGE_NONE)
+		return 0;
+	
+	if ((offset % sizeof(uint16_t)) ||
+		(header->strings_size < sizeof(*entry)) ||
+		(offset > (header->strings_size - sizeof(*entry))))
+		return -1;
+	
+	entry = (const void *)((const char *)header + header->strings + offset);
+	if ((entry->len > max) ||
+		(APPTREE_IMAGE_STRING_SIZE(entry->len) >
+			(header->strings_size - offset - sizeof(*entry))) ||
+		(entry->text[entry->len] != '\0'))
+		return -1;
+	
+	return 0;
+}
+
+/** @brief Checks a tree image before it is imported
+ *	@param parent The node the image is imported under.
+ *	@param header The image.
+ *	@param size Size of the buffer holding the image.
+ *	@param num_functions Number of functions in the function table.
+ *	@returns 0 if the image can be imported and -1 if otherwise.
+ *
+ *	The image is checked to fit into the buffer, every offset to lie within
+ *	the image, and every string entry to fit into the string table and to be
+ *	terminated after its length. The nodes are checked as with
+ *	apptree_validate_spec.
+ */
+static int apptree_validate_image(const struct apptree_node *parent,
+									const struct apptree_image_header *header,
+									size_t size, int num_functions)
+{
+	const struct apptree_image_node *nodes;
+	uint32_t words;
+	uint32_t i, p;
+	
+	if (size < sizeof(*header))
+		return -1;
+	
+	if ((header->magic != APPTREE_IMAGE_MAGIC) ||
+		(header->version != APPTREE_IMAGE_VERSION) ||
+		(header->node_size != sizeof(struct apptree_image_node)) ||
+		(header->size < sizeof(*header)) || (header->size > size) ||
+		(header->nodes % sizeof(uint32_t)) ||
+		(header->selection % sizeof(uint32_t)) ||
+		(header->strings % sizeof(uint16_t)))
+		return -1;
+	
+	words = (header->num_nodes + 31) / 32;
+	if ((header->nodes > header->size) ||
+		(header->num_nodes > ((header->size - header->nodes) /
+								sizeof(struct apptree_image_node))) ||
+		(header->selection > header->size) ||
+		(words > ((header->size - header->selection) / sizeof(uint32_t))) ||
+		(header->strings > header->size) ||
+		(header->strings_size > (header->size - header->strings)))
+		return -1;
+	
+	nodes = (const void *)((const char *)header + header->nodes);
+	
+	for (i = 0; i < header->num_nodes; i++) {
+		if ((nodes[i].mode > APPTREE_MODE_MULTI_SELECTION) ||
+			(nodes[i].function > num_functions))
+			return -1;
+		
+		if (apptree_validate_string(header, nodes[i].title, MAX_TITLE_WIDTH) ||
+			apptree_validate_string(header, nodes[i].info, MAX_INFO_WIDTH))
+			return -1;
+		
+		/* Only the children of Simple nodes may have children */
+		p = nodes[i].parent;
+		if (p == APPTREE_IMAGE_NONE) {
+			if (apptree_is_end(parent))
+				return -1;
+			continue;
+		}
+		
+		if (p >= i)
+			return -1;
+		
+		if (nodes[p].parent == APPTREE_IMAGE_NONE) {
+			if (parent->mode != APPTREE_MODE_SIMPLE)
+				return -1;
+		} else if (nodes[nodes[p].parent].mode != APPTREE_MODE_SIMPLE) {
+			return -1;
+		}
+	}
+	
+	return 0;
+}
+
+/** @brief Imports a tree image into the tree
+ *	@param control The apptree session.
+ *	@param nodes Array of handles for holding the new nodes, with one per node
+ *	of the image. It may be NULL if the nodes are taken from a pool.
+ *	@param parent Parent node to attach the image to.
+ *	@param image The image, which has to be aligned to 4 bytes and kept for
+ *	as long as the tree is.
+ *	@param size Size of the buffer holding the image, which the image has to
+ *	fit into.
+ *	@param functions Table of the functions bound to the nodes, which has to
+ *	be the table the image was exported with. It may be NULL if num_functions
+ *	is 0.
+ *	@param num_functions Number of functions in the table.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	Works like apptree_create_subtree, with a node of the tree created for
+ *	every node of the image, but the titles and infos point into the string
+ *	table of the image instead of being copied. Nodes sharing a string share
+ *	its entry. The whole image is checked against the buffer before any node
+ *	is created, so an image which is cut short or has corrupted offsets or
+ *	strings is rejected.
+ *
+ *	@note Importing costs a node of RAM per node of the image and one pass
+ *	over it, which replaces the calls of building the subtree node by node
+ *	but not the nodes themselves.
+ */
+int apptree_import_image(struct apptree_control *control,
+		struct apptree_node **nodes,
+		struct apptree_node *parent,
+		const void *image,
+		size_t size,
+		void (*const functions[])(struct apptree_node *parent, int child_idx),
+		int num_functions)
+{
+	const struct apptree_image_header *header = image;
+	const struct apptree_image_node *entry;
+	const uint32_t *selection;
+	char *strings;
+	struct apptree_tree *tree = control->tree;
+	struct apptree_node *node;
+	struct apptree_node *first;
+	uint32_t i;
+	
+	if ((image == NULL) || (num_functions < 0) ||
+		((functions == NULL) && num_functions) ||
+		apptree_open_structure(control))
+		return -1;
+	
+	first = tree->pool ? &tree->pool->nodes[tree->pool->used] : NULL;
+	if ((nodes == NULL) && (first == NULL))
+		return -1;
+	
+	if (apptree_validate_node(tree, parent))
+		return -1;
+	
+	if (apptree_validate_image(parent, header, size, num_functions))
+		return -1;
+	
+	if (tree->pool &&
+		((uint32_t)(tree->pool->size - tree->pool->used) < header->num_nodes))
+		return -1;
+	
+	entry		= (const void *)((const char *)image + header->nodes);
+	selection	= (const void *)((const char *)image + header->selection);
+	strings		= (char *)image + header->strings;
+	
+	for (i = 0; i < header->num_nodes; i++, entry++) {
+		if (entry->parent == APPTREE_IMAGE_NONE)
+			node = parent;
+		else if (nodes)
+			node = nodes[entry->parent];
+		else
+			node = &first[entry->parent];
+		
+		node = apptree_attach_node(tree, node,
+				(entry->title == APPTREE_IMAGE_NONE) ?
+					NULL : &strings[entry->title + sizeof(uint16_t)],
+				(entry->info == APPTREE_IMAGE_NONE) ?
+					NULL : &strings[entry->info + sizeof(uint16_t)],
+				(enum apptree_mode)entry->mode,
+				(selection[i / 32] >> (i % 32)) & 1,
+				entry->function ? functions[entry->function - 1] : NULL);
+		if (node == NULL)
+			return -1;
+		
+		if (nodes)
+			nodes[i] = node;
+	}
+	
+	return 0;
+}
+
+/** @brief Looks up a function in the function table
+ *	@param functions The function table.
+ *	@param num_functions Number of functions in the table.
+ *	@param function The function, which may be NULL.
+ *	@returns The position of the function plus 1, 0 for NULL, or -1 if the
+ *	function is not in the table.
+ */
+static int apptree_image_function(
+		void (*const functions[])(struct apptree_node *parent, int child_idx),
+		int num_functions,
+		void (*function)(struct apptree_node *parent, int child_idx))
+{
+	int i;
+	
+	if (function == NULL)
+		return 0;
+	
+	for (i = 0; i < num_functions; i++)
+		if (functions[i] == function)
+			return i + 1;
+	
+	return -1;
+}
+
+/** @brief Sizes up the descendants of a node for an image
+ *	@param node The node.
+ *	@param num_nodes Number of nodes, which is added to.
+ *	@param strings_size Size of the string entries, which is added to. This
+ *	is the size before repeated strings are merged.
+ *	@returns 0 if successful and -1 if a descendant cannot be exported.
+ */
+static int apptree_size_image(const struct apptree_node *node,
+								uint32_t *num_nodes, uint32_t *strings_size)
+{
+	const struct apptree_node *child;
+	int i;
+	
+#if APPTREE_LAZY_NODES
+	if (node->provider)
+		return -1;
+#endif
+	
+	for (i = 0; i < (int)node->num_child; i++) {
+		child = node->children[i];
+		
+		(*num_nodes)++;
+		if (child->title)
+			*strings_size += sizeof(uint16_t) + APPTREE_IMAGE_STRING_SIZE(
+					apptree_string_len(child->title, 0, MAX_TITLE_WIDTH));
+		if (child->info)
+			*strings_size += sizeof(uint16_t) + APPTREE_IMAGE_STRING_SIZE(
+					apptree_string_len(child->info, 0, MAX_INFO_WIDTH));
+		
+		if (apptree_size_image(child, num_nodes, strings_size))
+			return -1;
+	}
+	
+	return 0;
+}
+
+/** @brief Adds a string to the string table of an image
+ *	@param strings The string table.
+ *	@param offset Size of the string table so far, which is added to.
+ *	@param str The string, which may be NULL.
+ *	@param max The width the string is clipped to.
+ *	@returns The offset of the entry of the string, or APPTREE_IMAGE_NONE for
+ *	NULL.
+ *
+ *	A string which is already in the table is not added again, so repeated
+ *	labels such as "Enable" and "Back" are only stored once. The table is
+ *	searched from the start, which is quick enough for a tree exported once.
+ */
+static uint32_t apptree_export_string(char *strings, uint32_t *offset,
+										const char *str, size_t max)
+{
+	struct apptree_image_string *entry;
+	uint32_t pos;
+	size_t len;
+	
+	if (str == NULL)
+		return APPTREE_IMAGE_NONE;
+	
+	len = apptree_string_len(str, 0, max);
+	
+	for (pos = 0; pos < *offset; pos += sizeof(uint16_t) +
+						APPTREE_IMAGE_STRING_SIZE(entry->len)) {
+		entry = (void *)&strings[pos];
+		if ((entry->len == len) && !memcmp(entry->text, str, len))
+			return pos;
+	}
+	
+	entry = (void *)&strings[pos];
+	entry->len = (uint16_t)len;
+	memcpy(entry->text, str, len);
+	memset(&entry->text[len], '\0', APPTREE_IMAGE_STRING_SIZE(len) - len);
+	*offset += sizeof(uint16_t) + APPTREE_IMAGE_STRING_SIZE(len);
+	
+	return pos;
+}
+
+/** @brief Exports the descendants of a node into an image
+ *	@param node The node.
+ *	@param parent Position of the node in the image, or APPTREE_IMAGE_NONE
+ *	for the node the image is exported from.
+ *	@param header The image, whose num_nodes and strings_size count the nodes
+ *	and strings exported so far.
+ *	@param functions The function table.
+ *	@param num_functions Number of functions in the table.
+ *	@returns 0 if successful and -1 if a function is not in the table.
+ */
+static int apptree_export_node(const struct apptree_node *node,
+		uint32_t parent,
+		struct apptree_image_header *header,
+		void (*const functions[])(struct apptree_node *parent, int child_idx),
+		int num_functions)
+{
+	struct apptree_image_node *nodes;
+	struct apptree_image_node *entry;
+	uint32_t *selection;
+	char *strings;
+	uint32_t pos;
+	int function;
+	int i;
+	
+	nodes		= (void *)((char *)header + header->nodes);
+	selection	= (void *)((char *)header + header->selection);
+	strings		= (char *)header + header->strings;
+	
+	/* The children come first, so that the siblings stay together */
+	pos = header->num_nodes;
+	for (i = 0; i < (int)node->num_child; i++) {
+		function = apptree_image_function(functions, num_functions,
+											node->children[i]->function);
+		if (function < 0)
+			return -1;
+		
+		entry = &nodes[header->num_nodes];
+		entry->parent	= parent;
+		entry->title	= apptree_export_string(strings, &header->strings_size,
+								node->children[i]->title, MAX_TITLE_WIDTH);
+		entry->info		= apptree_export_string(strings, &header->strings_size,
+								node->children[i]->info, MAX_INFO_WIDTH);
+		entry->function	= (uint16_t)function;
+		entry->mode		= (uint8_t)node->children[i]->mode;
+		entry->reserved	= 0;
+		
+		if (apptree_is_selected(node, i))
+			selection[header->num_nodes / 32] |=
+										1u << (header->num_nodes % 32);
+		header->num_nodes++;
+	}
+	
+	for (i = 0; i < (int)node->num_child; i++)
+		if (apptree_export_node(node->children[i], pos + i, header,
+								functions, num_functions))
+			return -1;
+	
+	return 0;
+}
+
+/** @brief Exports the descendants of a node as a tree image
+ *	@param control The apptree session.
+ *	@param parent The node whose descendants are exported, which is usually
+ *	the master. The node itself is not part of the image.
+ *	@param buffer Buffer for the image, which has to be aligned to 4 bytes.
+ *	It may be NULL to only get the size needed for the image.
+ *	@param size Size of the buffer, which is replaced with the size of the
+ *	image once it is written. Otherwise it is replaced with the size needed,
+ *	which is counted before repeated strings are merged.
+ *	@param functions Table of the functions bound to the nodes. Every
+ *	function has to be in the table, and the same table has to be given to
+ *	apptree_import_image.
+ *	@param num_functions Number of functions in the table.
+ *	@returns 0 if the image is written and -1 if otherwise.
+ *
+ *	The tree has to be frozen by apptree_enable, or constant. Lazy nodes
+ *	cannot be exported. This function suits a host tool that builds the menu
+ *	with the usual setup functions and writes the image to a file to be
+ *	flashed, as well as a device mirroring its tree to a PC tool.
+ */
+int apptree_export_image(struct apptree_control *control,
+		const struct apptree_node *parent,
+		void *buffer,
+		size_t *size,
+		void (*const functions[])(struct apptree_node *parent, int child_idx),
+		int num_functions)
+{
+	struct apptree_image_header *header = buffer;
+	uint32_t num_nodes = 0;
+	uint32_t strings_size = 0;
+	uint32_t words;
+	size_t total;
+	
+	if ((control->tree == NULL) || !control->tree->frozen ||
+		(parent == NULL) || (size == NULL) || (num_functions < 0) ||
+		((functions == NULL) && num_functions))
+		return -1;
+	
+	if (apptree_size_image(parent, &num_nodes, &strings_size))
+		return -1;
+	
+	words = (num_nodes + 31) / 32;
+	total = sizeof(*header) + num_nodes * sizeof(struct apptree_image_node) +
+			words * sizeof(uint32_t) + strings_size;
+	
+	if ((buffer == NULL) || (*size < total)) {
+		*size = total;
+		return -1;
+	}
+	
+	header->magic			= APPTREE_IMAGE_MAGIC;
+	header->version			= APPTREE_IMAGE_VERSION;
+	header->node_size		= sizeof(struct apptree_image_node);
+	header->size			= (uint32_t)total;
+	header->num_nodes		= 0;
+	header->nodes			= sizeof(*header);
+	header->selection		= header->nodes +
+								num_nodes * sizeof(struct apptree_image_node);
+	header->strings			= header->selection + words * sizeof(uint32_t);
+	header->strings_size	= 0;
+	
+	memset((char *)buffer + header->selection, 0, words * sizeof(uint32_t));
+	
+	if (apptree_export_node(parent, APPTREE_IMAGE_NONE, header,
+							functions, num_functions))
+		return -1;
+	
+	/* The image ends with the string table, which shrinks as strings merge */
+	header->size = header->strings + header->strings_size;
+	*size = header->size;
+	return 0;
+}
+
+/** @}*/
+#endif
+
+/* -------------------------------------------------------------------------- */
+/** @name Input Handling Functions
+ *	Handles the user input as well as any subsequent results from the input.
+ */
+/** @{*/
+
+/** States of the escape sequence decoder */
+#define APPTREE_INPUT_GROUND			0
+#define APPTREE_INPUT_ESCAPE			1
+#define APPTREE_INPUT_SEQUENCE			2
+#define APPTREE_INPUT_MODIFIERS			3
+
+/** Byte starting an escape sequence */
+#define APPTREE_ESCAPE					'\033'
+
+/** @brief Escape sequence sent by a terminal key */
+struct apptree_key_sequence {
+	/** Final byte of the sequence */
+	unsigned char final;
+	/** Numeric parameter of the sequence, or 0 if any parameter is accepted */
+	unsigned char param;
+	/** Action of the key */
+	unsigned char action;
+};
+
+/** Escape sequences of the cursor and editing keys, which are decoded
+ *	whether they are introduced by "ESC [" or, in application mode, "ESC O".
+ *	The cursor keys are decoded with any modifier, such as "ESC [ 1 ; 5 A".
+ */
+static const struct apptree_key_sequence apptree_key_sequences[] = {
+	{ 'A', 0, APPTREE_ACTION_UP },
+	{ 'B', 0, APPTREE_ACTION_DOWN },
+	{ 'C', 0, APPTREE_ACTION_SELECT },
+	{ 'D', 0, APPTREE_ACTION_BACK },
+	{ 'H', 0, APPTREE_ACTION_HOME },
+	{ '~', 1, APPTREE_ACTION_HOME },
+	{ '~', 7, APPTREE_ACTION_HOME },
+	{ '~', 5, APPTREE_ACTION_PAGE_UP },
+	{ '~', 6, APPTREE_ACTION_PAGE_DOWN }
+};
+
+/** @brief Builds the action of every input byte from the key bindings
+ *	@param control The apptree session.
+ *
+ *	The bindings are entered from the last to the first, so that a key bound
+ *	twice keeps the action it had when the bindings were compared in order.
+ *	The page keys are only entered if they are bound.
+ */
+static void apptree_build_key_map(struct apptree_control *control)
+{
+	const struct apptree_keybindings *keys = control->keys;
+	
+	memset(control->key_map, APPTREE_ACTION_NONE, sizeof(control->key_map));
+	
+	if (keys->page_down)
+		control->key_map[(unsigned char)keys->page_down] =
+												APPTREE_ACTION_PAGE_DOWN;
+	if (keys->page_up)
+		control->key_map[(unsigned char)keys->page_up] = APPTREE_ACTION_PAGE_UP;
+	
+	control->key_map[(unsigned char)keys->home]		= APPTREE_ACTION_HOME;
+	control->key_map[(unsigned char)keys->back]		= APPTREE_ACTION_BACK;
+	control->key_map[(unsigned char)keys->select]	= APPTREE_ACTION_SELECT;
+	control->key_map[(unsigned char)keys->down]		= APPTREE_ACTION_DOWN;
+	control->key_map[(unsigned char)keys->up]		= APPTREE_ACTION_UP;
+	
+	control->input_state = APPTREE_INPUT_GROUND;
+}
+
+/** @brief Looks up the action of an escape sequence
+ *	@param param The numeric parameter of the sequence, or 0 if none.
+ *	@param final The final byte of the sequence.
+ *	@returns The action of the sequence, or APPTREE_ACTION_NONE if the
+ *	sequence is unknown.
+ */
+static enum apptree_action apptree_decode_sequence(unsigned char param,
+													unsigned char final)
+{
+	size_t i;
+	
+	for (i = 0; i < (sizeof(apptree_key_sequences) /
+					sizeof(apptree_key_sequences[0])); i++) {
+		if ((apptree_key_sequences[i].final == final) &&
+			((apptree_key_sequences[i].param == param) ||
+			(apptree_key_sequences[i].param == 0)))
+			return (enum apptree_action)apptree_key_sequences[i].action;
+	}
+	
+	return APPTREE_ACTION_NONE;
+}
+
+/** @brief Decodes an input byte into an action
+ *	@param control The apptree session.
+ *	@param input The input byte.
+ *	@returns The action of the input, or APPTREE_ACTION_IGNORE if the input
+ *	is part of an escape sequence which is not complete yet or is unknown.
+ *
+ *	Single keys are looked up in the key map. Escape sequences are decoded by
+ *	a state machine which keeps its state across calls, so a sequence may be
+ *	split across several calls of apptree_handle_input. An escape byte which
+ *	is not followed by "[" or "O" is dropped. If the escape byte is itself
+ *	bound to a key, sequences are not decoded.
+ */
+static enum apptree_action apptree_decode_input(struct apptree_control *control,
+												char input)
+{
+	unsigned char byte = (unsigned char)input;
+	enum apptree_action action;
+	
+	switch (control->input_state) {
+	case APPTREE_INPUT_ESCAPE:
+		if ((byte == '[') || (byte == 'O')) {
+			control->input_state = APPTREE_INPUT_SEQUENCE;
+			control->input_param = 0;
+			return APPTREE_ACTION_IGNORE;
+		}
+		
+		control->input_state = APPTREE_INPUT_GROUND;
+		break;
+		
+	case APPTREE_INPUT_SEQUENCE:
+	case APPTREE_INPUT_MODIFIERS:
+		if ((control->input_state == APPTREE_INPUT_SEQUENCE) &&
+			(byte >= '0') && (byte <= '9')) {
+			if (control->input_param < 100)
+				control->input_param = control->input_param * 10 +
+										(byte - '0');
+			return APPTREE_ACTION_IGNORE;
+		}
+		
+		/* Only the first parameter is kept, and the modifiers after the ";"
+		 * are skipped along with any intermediate bytes
+		 */
+		if ((byte >= 0x20) && (byte < 0x40)) {
+			control->input_state = APPTREE_INPUT_MODIFIERS;
+			return APPTREE_ACTION_IGNORE;
+		}
+		
+		control->input_state = APPTREE_INPUT_GROUND;
+		action = apptree_decode_sequence(control->input_param, byte);
+		if (action == APPTREE_ACTION_NONE)
+			return APPTREE_ACTION_IGNORE;
+		return action;
+	}
+	
+	if ((byte == APPTREE_ESCAPE) &&
+		(control->key_map[byte] == APPTREE_ACTION_NONE)) {
+		control->input_state = APPTREE_INPUT_ESCAPE;
+		return APPTREE_ACTION_IGNORE;
+	}
+	
+	return (enum apptree_action)control->key_map[byte];
+}
+
+/** @brief Adjust the value of frame_pos
+ *	@param control The apptree session.
+ *	
+ *	The value of frame_pos is adjusted based on the value of select_pos.
+ *	Therefore, this function is called after every update to the value of
+ *	select_pos. It helps to handle the following 4 conditions.
+ *
+ *		1. Select arrow loops from bottom to top. 
+ *		2. Select arrow loops from top to bottom.
+ *		3. Select arrow moves downward beyond current frame.
+ *		4. Select arrow moves upward beyond current frame.
+ */
+static void apptree_adjust_frame_pos(struct apptree_control *control)
+{
+	if (control->select_pos == 0) {
+		control->frame_pos = 0;
+	} else if (control->select_pos == (control->picture_height - 1)) {
+		control->frame_pos = control->picture_height - FRAME_HEIGHT;
+		
+		if(control->frame_pos < 0)
+			control->frame_pos = 0;
+		
+	} else if (control->select_pos >= (control->frame_pos + FRAME_HEIGHT)) {
+		control->frame_pos++;
+	} else if (control->select_pos < control->frame_pos) {
+		control->frame_pos--;
+	}
+	
+#if APPTREE_LAZY_NODES
+	apptree_fill_window(control);
+#endif
+}
+
+/** @brief Increase the value of select_pos
+ *	@param control The apptree session.
+ *
+ *	This function increases the value of select_pos and also helps to reposition
+ *	it should the value reach the end of the picture_length.
+ */
+static void apptree_increase_select_pos(struct apptree_control *control)
+{
+	if (control->select_pos == (control->picture_height - 1))
+		control->select_pos = 0;
+	else
+		control->select_pos++;
+}
+
+/** @brief Decreases the value of select_pos
+ *	@param control The apptree session.
+ *
+ *	This function decreases the value of select_pos and also helps to reposition
+ *	it should the value reach the end of the picture_length.
+ */
+static void apptree_decrease_select_pos(struct apptree_control *control)
+{
+	if (control->select_pos == 0)
+		control->select_pos = control->picture_height - 1;
+	else
+		control->select_pos--;
+}
+
+/** @brief Update the selected field of a node's children
+ *	@param parent The parent node.
+ *	@param child_index The index of the child that has been selected.
+ *
+ *	This function updates the selected field of a node's children if the node
+ *	is not Simple. This function should only be called after a recent selection
+ *	has been made by the user. A Single Selection node tracks its selected
+ *	child, so only the previous and the new selection are touched. A Multi
+ *	Selection node flips the bit of the child in its bitset.
+ */
+static void apptree_update_selected(struct apptree_node *parent,
+									int child_index)
+{
+	struct apptree_parent_state *record = apptree_get_parent_state(parent);
+	int old_index;
+	
+	if (record == NULL)
+		return;
+	
+	switch (parent->mode)
+	{
+	case APPTREE_MODE_SIMPLE:
+		/* do nothing */
+		break;
+	
+	case APPTREE_MODE_SINGLE_SELECTION:
+		old_index = record->selected_child;
+		if (old_index >= 0)
+			parent->children[old_index]->state->selected = false;
+		
+		parent->children[child_index]->state->selected = true;
+		record->selected_child = child_index;
+		break;
+		
+	case APPTREE_MODE_MULTI_SELECTION:
+		record->selection[child_index / 32] ^=
+			(uint32_t)1 << (child_index % 32);
+		break;
+	}		
+}
+
+/** @brief Handles a series of "up" and "down" inputs
+ *	@param control The apptree session.
+ *	@param moves Number of rows to move the select arrow by, which is negative
+ *	for upward moves.
+ *
+ *	The moves are applied one row at a time, so the frame ends up exactly where
+ *	it would have been had each input been handled on its own.
+ */
+static void apptree_handle_move_input(struct apptree_control *control,
+										int moves)
+{
+	if ((moves == 0) || (control->picture_height == 0))
+		return;
+	
+	for (; moves > 0; moves--) {
+		apptree_increase_select_pos(control);
+		apptree_adjust_frame_pos(control);
+	}
+	
+	for (; moves < 0; moves++) {
+		apptree_decrease_select_pos(control);
+		apptree_adjust_frame_pos(control);
+	}
+	
+	control->redraw = true;
+}
+
+/** @brief Handles a "select" input
+ *	@param control The apptree session.
+ */
+static void apptree_handle_select_input(struct apptree_control *control)
+{
+	struct apptree_node *child;
+	
+#if APPTREE_LAZY_NODES
+	const struct apptree_provider *provider = control->current->provider;
+	
+	if (provider) {
+		if (provider->function && (control->picture_height > 0)) {
+			provider->function(control->current, control->select_pos);
+			apptree_refresh_picture(control);
+			control->redraw = true;
+		}
+		return;
+	}
+#endif
+	
+	if (control->picture_height == 0)
+		return;
+	
+	child = control->current->children[control->select_pos];
+
+	if (apptree_count_children(child) > 0) {	
+#if APPTREE_PATH_DEPTH
+		if (control->path_len < APPTREE_PATH_DEPTH) {
+			control->path[control->path_len].node		= control->current;
+			control->path[control->path_len].frame_pos	= control->frame_pos;
+			control->path[control->path_len].select_pos	= control->select_pos;
+		}
+		control->path_len++;
+		
+#endif
+		control->current = child;
+		
+		control->frame_pos = 0;
+		control->select_pos = 0;
+		
+		apptree_populate_picture(control);
+		control->redraw = true;
+	} else {
+		if(child->function) {
+			child->function(control->current, control->select_pos);
+			apptree_update_selected(control->current, control->select_pos);
+			control->redraw = true;
+		}
+	}
+}
+
+#if APPTREE_PATH_DEPTH
+/** @brief Returns to a level left earlier
+ *	@param control The apptree session.
+ *	@param crumb The view of the level, which must be the new current node.
+ *
+ *	The frame and select arrow are pulled back within the picture should it
+ *	have shrunk since, as a lazy node may have.
+ */
+static void apptree_restore_crumb(struct apptree_control *control,
+									const struct apptree_crumb *crumb)
+{
+	control->frame_pos = crumb->frame_pos;
+	
+	apptree_populate_picture(control);
+	apptree_move_to(control, crumb->select_pos, crumb->frame_pos);
+}
+#endif
+
+/** @brief Handles a "back" input.
+ *	@param control The apptree session.
+ *
+ *	With APPTREE_PATH_DEPTH, the parent is shown as it was left.
+ */
+static void apptree_handle_back_input(struct apptree_control *control)
+{
+	if (control->current == control->tree->master)
+		return;
+	
+	control->current = control->current->parent;
+	
+#if APPTREE_PATH_DEPTH
+	if (control->path_len > 0)
+		control->path_len--;
+	if ((control->path_len < APPTREE_PATH_DEPTH) &&
+		(control->path[control->path_len].node == control->current)) {
+		apptree_restore_crumb(control, &control->path[control->path_len]);
+		return;
+	}
+	
+#endif
+	control->frame_pos = 0;
+	control->select_pos = 0;
+
+	apptree_populate_picture(control);
+	control->redraw = true;
+}
+
+/** @brief Handles a "home" input.
+ *	@param control The apptree session.
+ *
+ *	With APPTREE_PATH_DEPTH, the master is shown as it was left.
+ */
+static void apptree_handle_home_input(struct apptree_control *control)
+{
+	if (control->current == control->tree->master)
+		return;
+	
+	control->current = control->tree->master;
+	
+#if APPTREE_PATH_DEPTH
+	if ((control->path_len > 0) &&
+		(control->path[0].node == control->current)) {
+		control->path_len = 0;
+		apptree_restore_crumb(control, &control->path[0]);
+		return;
+	}
+	control->path_len = 0;
+	
+#endif
+	control->frame_pos = 0;
+	control->select_pos = 0;
+
+	apptree_populate_picture(control);
+	control->redraw = true;
+}
+
+/** @brief Moves the select arrow and the frame
+ *	@param control The apptree session.
+ *	@param select_pos The new position of the select arrow, which is pulled
+ *	back within the picture.
+ *	@param frame_pos The new position of the frame, which is pulled back as
+ *	little as needed to show the select arrow.
+ */
+static void apptree_move_to(struct apptree_control *control,
+							int select_pos, int frame_pos)
+{
+	int last_frame_pos = control->picture_height - FRAME_HEIGHT;
+	
+	if (select_pos >= control->picture_height)
+		select_pos = control->picture_height - 1;
+	if (select_pos < 0)
+		select_pos = 0;
+	
+	if (frame_pos > select_pos)
+		frame_pos = select_pos;
+	if (frame_pos <= (select_pos - FRAME_HEIGHT))
+		frame_pos = select_pos - FRAME_HEIGHT + 1;
+	if (frame_pos > last_frame_pos)
+		frame_pos = last_frame_pos;
+	if (frame_pos < 0)
+		frame_pos = 0;
+	
+	control->select_pos = select_pos;
+	control->frame_pos	= frame_pos;
+	
+#if APPTREE_LAZY_NODES
+	apptree_fill_window(control);
+#endif
+	
+	control->redraw = true;
+}
+
+/** @brief Handles "page up" and "page down" inputs
+ *	@param control The apptree session.
+ *	@param pages Number of frames to move by, which is negative for upward
+ *	moves.
+ *
+ *	The select arrow and the frame move together by FRAME_HEIGHT rows per
+ *	page, stopping at either end of the picture instead of looping around.
+ */
+static void apptree_handle_page_input(struct apptree_control *control,
+										int pages)
+{
+	if (control->picture_height == 0)
+		return;
+	
+	apptree_move_to(control, control->select_pos + pages * FRAME_HEIGHT,
+					control->frame_pos + pages * FRAME_HEIGHT);
+}
+
+#if APPTREE_TYPE_AHEAD
+/** @brief Handles a character typed ahead
+ *	@param control The apptree session.
+ *	@param input The character, which is not bound to any key.
+ *
+ *	The character is added to the characters typed since the last key binding,
+ *	and the select arrow jumps to the first child whose title starts with
+ *	them, without regard to case. A character which would match no child is
+ *	dropped. Items of lazy nodes cannot be searched.
+ */
+static void apptree_handle_search_input(struct apptree_control *control,
+										char input)
+{
+	int index;
+	
+	if ((input < ' ') || (input > '~') ||
+		(control->search_len == APPTREE_SEARCH_LENGTH))
+		return;
+	
+#if APPTREE_LAZY_NODES
+	if (control->current->provider)
+		return;
+#endif
+	
+	control->search[control->search_len++] = input;
+	
+	index = apptree_find_prefix(control->tree, control->current,
+								control->search, control->search_len);
+	if (index < 0) {
+		control->search_len--;
+		return;
+	}
+	
+	apptree_move_to(control, index, control->frame_pos);
+}
+#endif
+
+/** @brief Handles user inputs
+ *	@param control The apptree session.
+ *	@returns 0 if a new input or message is detected and -1 if otherwise.
+ *
+ *	Any posted messages are applied first. This function then drains all
+ *	pending user inputs, up to APPTREE_RX_BUFFER_SIZE of them, decodes them
+ *	into actions through the key map and the escape sequences of the cursor
+ *	keys, and handles them in order.
+ *	Runs of consecutive "up" or "down" inputs are handled as a single move.
+ *	The menu is printed once after all inputs have been handled, so bursts of
+ *	inputs such as held down keys do not cost a redraw per input. With a frame
+ *	limit, the menu is left to be printed by apptree_tick instead. With
+ *	type-ahead, printable inputs bound to no key are searched for among the
+ *	titles of the children.
+ */
+int apptree_handle_input(struct apptree_control *control)
+{
+	char input;
+	enum apptree_action action;
+	int moves = 0;
+	int messages = 0;
+	int i;
+#if APPTREE_STATS
+	uint32_t start = control->timestamp ? control->timestamp() : 0;
+#endif
+	
+	/* Inputs are left unread until the update is committed */
+	if (!control->enabled || control->update_depth)
+		return -1;
+	
+#if APPTREE_MESSAGE_QUEUE_SIZE
+	messages = apptree_process_messages(control);
+	APPTREE_STATS_ADD(&control->io, messages, messages);
+#endif
+	
+	for (i = 0; i < APPTREE_RX_BUFFER_SIZE; i++) {
+		if (apptree_read(&control->io, &input))
+			break;
+		
+		APPTREE_STATS_ADD(&control->io, inputs, 1);
+		
+		action = apptree_decode_input(control, input);
+		
+		if (action == APPTREE_ACTION_IGNORE)
+			continue;
+		
+		/* A change of direction ends the run of moves */
+		if (action == APPTREE_ACTION_UP) {
+			if (moves > 0) {
+				apptree_handle_move_input(control, moves);
+				moves = 0;
+			}
+			moves--;
+		} else if (action == APPTREE_ACTION_DOWN) {
+			if (moves < 0) {
+				apptree_handle_move_input(control, moves);
+				moves = 0;
+			}
+			moves++;
+		} else {
+			apptree_handle_move_input(control, moves);
+			moves = 0;
+			
+			switch (action) {
+			case APPTREE_ACTION_SELECT:
+				apptree_handle_select_input(control);
+				break;
+			case APPTREE_ACTION_BACK:
+				apptree_handle_back_input(control);
+				break;
+			case APPTREE_ACTION_HOME:
+				apptree_handle_home_input(control);
+				break;
+			case APPTREE_ACTION_PAGE_UP:
+				apptree_handle_page_input(control, -1);
+				break;
+			case APPTREE_ACTION_PAGE_DOWN:
+				apptree_handle_page_input(control, 1);
+				break;
+			default:
+#if APPTREE_TYPE_AHEAD
+				apptree_handle_search_input(control, input);
+				continue;
+#else
+				break;
+#endif
+			}
+		}
+		
+#if APPTREE_TYPE_AHEAD
+		control->search_len = 0;
+#endif
+	}
+	
+	if ((i == 0) && (messages == 0))
+		return -1;
+	
+	apptree_handle_move_input(control, moves);
+	
+	if (control->redraw)
+		apptree_schedule_menu(control);
+	
+#if APPTREE_STATS
+	apptree_record_time(control, start);
+#endif
+	
+	return 0;
+}
+
+/** @brief Renders part of the menu
+ *	@param control The apptree session.
+ *	@param budget The maximum number of characters to be written.
+ *	@returns 1 if there is more to be rendered and 0 if otherwise.
+ *
+ *	Writes at most budget characters of a scheduled menu. Rows are composed
+ *	one at a time, only once the output of the previous row has been written
+ *	in full. This function is only useful in incremental render mode.
+ */
+int apptree_render_step(struct apptree_control *control, int budget)
+{
+	if (!control->incremental || control->update_depth)
+		return 0;
+	
+	for (;;) {
+		budget -= apptree_io_drain(&control->io, budget);
+		if (apptree_io_pending(&control->io))
+			return 1;
 		
-	} else if (control.select_pos >= (control.frame_pos + FRAME_HEIGHT)) {
-		control.frame_pos++;
-	} else if (control.select_pos < control.frame_pos) {
-		control.frame_pos--;
+		if (control->render_row >= TERMINAL_HEIGHT)
+			return 0;
+		
+		if (budget <= 0)
+			return 1;
+		
+		if (control->render_row == 0)
+			apptree_scroll_frame(control);
+		apptree_print_line(control, control->render_row++);
+		if (control->render_row == TERMINAL_HEIGHT)
+			apptree_io_flush_display(&control->io);
+	}
+}
+
+/** @brief Advances the frame clock
+ *	@param control The apptree session.
+ *	@returns 1 if a menu is printed and 0 if otherwise.
+ *
+ *	This function is called at a fixed rate, for instance from the periodic
+ *	loop of the UI task, when a frame limit is set. The menu is printed once
+ *	it has changed, the frame interval has passed and, in incremental render
+ *	mode, the previous menu has been rendered in full.
+ *
+ *	@note This function prints the menu, so it must not be called from an
+ *	interrupt.
+ */
+int apptree_tick(struct apptree_control *control)
+{
+	if (!control->enabled || (control->frame_interval == 0) ||
+		control->update_depth)
+		return 0;
+	
+	if (control->frame_ticks < control->frame_interval)
+		control->frame_ticks++;
+	
+	if (!control->redraw || (control->frame_ticks < control->frame_interval))
+		return 0;
+	
+	if (control->incremental &&
+		((control->render_row < TERMINAL_HEIGHT) ||
+		apptree_io_pending(&control->io)))
+		return 0;
+	
+	control->redraw		 = false;
+	control->frame_ticks = 0;
+	apptree_print_menu(control);
+	return 1;
+}
+
+/** @}*/
+
+
+/* -------------------------------------------------------------------------- */
+/** @name Task Functions
+ *	Lets an apptree session be driven from a multitasking system. The session
+ *	is owned by a single UI task, which calls apptree_handle_input and, in
+ *	incremental render mode, apptree_render_step, typically at a low priority.
+ *	Other tasks never touch the session directly. Instead, they post inputs
+ *	and changes to the tree, which the UI task picks up on its next call to
+ *	apptree_handle_input. Posting never waits on the UI task, so a higher
+ *	priority task is not held up by the rendering, and a change can never
+ *	show up halfway through a menu.
+ */
+/** @{*/
+
+/** @brief Binds the functions serializing the tasks which post messages.
+ *	@param control The apptree session.
+ *	@param lock Function taking a lock, such as a mutex of the RTOS.
+ *	@param unlock Function releasing the lock.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	The lock is only taken by apptree_post_message, and is only needed when
+ *	more than one task posts messages. The UI task never takes it.
+ *
+ *	@note The apptree has to be compiled with APPTREE_MESSAGE_QUEUE_SIZE set
+ *	for messages to be available.
+ */
+int apptree_set_lock(struct apptree_control *control,
+						void (*lock)(void), void (*unlock)(void))
+{
+#if APPTREE_MESSAGE_QUEUE_SIZE
+	if ((control->tree == NULL) || ((lock == NULL) != (unlock == NULL)))
+		return -1;
+	
+	control->lock	= lock;
+	control->unlock = unlock;
+	return 0;
+#else
+	(void)control;
+	(void)lock;
+	(void)unlock;
+	return -1;
+#endif
+}
+
+/** @brief Posts a change to a node
+ *	@param control The apptree session.
+ *	@param message The change, which is copied into the queue.
+ *	@returns 0 if successful and -1 if the queue is full or unavailable, or
+ *	if the change is not valid.
+ *
+ *	The change is applied by the UI task on its next call to
+ *	apptree_handle_input, which also prints the menu if the node is shown.
+ *	Changes to nodes which are not in the tree are refused, and changes which
+ *	are still queued when their node is removed are dropped.
+ *
+ *	@note The nodes of a constant tree keep their title and info in read-only
+ *	memory, so APPTREE_MESSAGE_TITLE and APPTREE_MESSAGE_INFO are refused for
+ *	them.
+ */
+int apptree_post_message(struct apptree_control *control,
+							const struct apptree_message *message)
+{
+#if APPTREE_MESSAGE_QUEUE_SIZE
+	unsigned int tail;
+	int ret = -1;
+	
+	if ((control->tree == NULL) ||
+		apptree_validate_message(control->tree, message))
+		return -1;
+	
+	if (control->lock)
+		control->lock();
+	
+	tail = control->message_tail;
+	if ((tail - control->message_head) != APPTREE_MESSAGE_QUEUE_SIZE) {
+		control->messages[tail & (APPTREE_MESSAGE_QUEUE_SIZE - 1)] = *message;
+		APPTREE_MEMORY_BARRIER();
+		control->message_tail = tail + 1;
+		ret = 0;
 	}
+	
+	if (control->unlock)
+		control->unlock();
+	
+	return ret;
+#else
+	(void)control;
+	(void)message;
+	return -1;
+#endif
 }
 
-/** @brief Increase the value of select_pos
+/** @brief Posts an input
+ *	@param control The apptree session.
+ *	@param input The input, which is handled as if it was read from the
+ *	binded input.
+ *	@returns 0 if successful and -1 if the queue is full or unavailable.
  *
- *	This function increases the value of select_pos and also helps to reposition
- *	it should the value reach the end of the picture_length.
+ *	The input queue is lock-free with a single producer, so this may be
+ *	called from an interrupt or from a single input task.
+ *
+ *	@note The apptree has to be compiled with APPTREE_INPUT_QUEUE_SIZE set for
+ *	the input queue to be available.
  */
-static void apptree_increase_select_pos(void)
+int apptree_post_input(struct apptree_control *control, char input)
 {
-	if (control.select_pos == (control.picture_height - 1))
-		control.select_pos = 0;
-	else
-		control.select_pos++;
+	return apptree_io_post_input(&control->io, input);
 }
 
-/** @brief Decreases the value of select_pos
+/** @brief Checks if a change can be applied to its node
+ *	@param tree The tree of the session.
+ *	@param message The change.
+ *	@returns 0 if it can be and -1 if otherwise.
  *
- *	This function decreases the value of select_pos and also helps to reposition
- *	it should the value reach the end of the picture_length.
+ *	The node has to be attached to the tree, so changes to removed nodes are
+ *	refused. Constant nodes are the only nodes with no tree, apart from
+ *	removed nodes, and may sit in read-only memory, so their title and info
+ *	are never written.
  */
-static void apptree_decrease_select_pos(void)
+static int apptree_validate_message(struct apptree_tree *tree,
+									const struct apptree_message *message)
 {
-	if (control.select_pos == 0)
-		control.select_pos = control.picture_height - 1;
-	else
-		control.select_pos--;
+	if ((message == NULL) || (message->node == NULL))
+		return -1;
+	
+	if (tree->master->tree == tree)
+		return (message->node->tree == tree) ? 0 : -1;
+	
+	if ((message->type == APPTREE_MESSAGE_TITLE) ||
+		(message->type == APPTREE_MESSAGE_INFO))
+		return -1;
+	
+	return 0;
 }
 
-/** @brief Update the selected field of a node's children
- *	@param parent The parent node.
- *	@param child_index The index of the child that has been selected.
+/** @brief Sets whether a node is selected
+ *	@param node The node.
+ *	@param selected Set as true to select the node.
  *
- *	This function updates the selected field of a node's children if the node
- *	is not Simple. This function should only be called after a recent selection
- *	has been made by the user.
+ *	Selecting a child of a Single Selection node clears the previous
+ *	selection, which is tracked by the parent. The children of a Multi
+ *	Selection node are set in the bitset of the parent. Nothing is changed
+ *	if the node is not found at its position among the children.
  */
-static void apptree_update_selected(struct apptree_node *parent,
-									int child_index)
+static void apptree_set_selected(struct apptree_node *node, bool selected)
 {
-	struct list_head *head;
-	struct apptree_node *child;
-	int i;
+	struct apptree_node *parent = node->parent;
+	struct apptree_parent_state *record;
+	uint32_t bit;
+	int i = node->state->child_index;
 	
-	switch (parent->mode)
+	if ((parent == NULL) || (parent->mode == APPTREE_MODE_SIMPLE)) {
+		node->state->selected = selected;
+		return;
+	}
+	
+	record = apptree_get_parent_state(parent);
+	if ((record == NULL) || (i >= (int)parent->num_child) ||
+		(parent->children[i] != node))
+		return;
+	
+	if (parent->mode == APPTREE_MODE_MULTI_SELECTION) {
+		bit = (uint32_t)1 << (i % 32);
+		if (selected)
+			record->selection[i / 32] |= bit;
+		else
+			record->selection[i / 32] &= ~bit;
+		return;
+	}
+	
+	if (selected)
+		apptree_update_selected(parent, i);
+	else if (record->selected_child == i)
+		record->selected_child = -1;
+	
+	node->state->selected = selected;
+}
+
+/** @brief Sets whether a node is selected while the child index is outdated
+ *	@param node The node.
+ *	@param selected Set as true to select the node.
+ *
+ *	Only the selected flags of the children are set, as before the tree is
+ *	frozen, and the selections are tracked again once the update is
+ *	committed. Selecting a child of a Single Selection node clears the flags
+ *	of its siblings.
+ */
+static void apptree_set_selected_flag(struct apptree_node *node,
+										bool selected)
+{
+	struct apptree_node *sibling;
+	
+	if (selected && node->parent &&
+		(node->parent->mode == APPTREE_MODE_SINGLE_SELECTION))
+		for (sibling = node->parent->last_child; sibling;
+				sibling = sibling->prev_sibling)
+			sibling->state->selected = false;
+	
+	node->state->selected = selected;
+}
+
+/** @brief Applies a posted message or a change made in an update
+ *	@param control The apptree session.
+ *	@param message The message.
+ */
+static void apptree_apply_message(struct apptree_control *control,
+									const struct apptree_message *message)
+{
+	struct apptree_node *node = message->node;
+	
+	switch (message->type)
 	{
-	case APPTREE_MODE_SIMPLE:
-		/* do nothing */
+	case APPTREE_MESSAGE_SELECT:
+		if (!control->tree->frozen || control->update_structure)
+			apptree_set_selected_flag(node, message->value.selected);
+		else
+			apptree_set_selected(node, message->value.selected);
 		break;
-	
-	case APPTREE_MODE_SINGLE_SELECTION:
-		for (i = 0; i < parent->num_child; i++) {
-			head = list_travese_to_index(&parent->list_parent, i);
-			child = container_of(head, struct apptree_node, list_child);
-			
-			if (i == child_index)
-				child->selected = true;
-			else
-				child->selected = false;
-		}
+		
+	case APPTREE_MESSAGE_TITLE:
+		node->title		= message->value.text;
+		node->title_len = apptree_string_len(node->title, 0, MAX_TITLE_WIDTH);
+		if (node->parent)
+			apptree_touch_rows(control->tree, node->parent);
+#if APPTREE_TYPE_AHEAD
+		if (node->parent && !control->update_structure &&
+			apptree_sorted_children(control->tree, node->parent))
+			apptree_sort_children(node->parent,
+					apptree_sorted_children(control->tree, node->parent));
+#endif
 		break;
 		
-	case APPTREE_MODE_MULTI_SELECTION:
-		head = list_travese_to_index(&parent->list_parent, child_index);
-		child = container_of(head, struct apptree_node, list_child);
-	
-		if (child->selected)
-			child->selected = false;
-		else
-			child->selected = true;
+	case APPTREE_MESSAGE_INFO:
+		node->info		= message->value.text;
+		node->info_len	= apptree_string_len(node->info, 0, MAX_INFO_WIDTH);
+		break;
 		
+	case APPTREE_MESSAGE_REFRESH:
+		if ((node == control->current) && !control->update_structure)
+			apptree_refresh_picture(control);
 		break;
-	}		
+	}
+	
+	if ((node == control->current) || (node->parent == control->current))
+		control->redraw = true;
 }
 
-/** @brief Handles an "up" input
+#if APPTREE_MESSAGE_QUEUE_SIZE
+/** @brief Applies all posted messages
+ *	@param control The apptree session.
+ *	@returns The number of messages applied.
+ *
+ *	Only the consumer side of the queue is touched, so the lock is not taken.
+ *	At most one queue of messages is applied, so that tasks which keep on
+ *	posting cannot hold up the inputs.
  */
-static void apptree_handle_up_input(void)
+static int apptree_process_messages(struct apptree_control *control)
 {
-	apptree_decrease_select_pos();
-	apptree_adjust_frame_pos();
-	apptree_print_menu();
+	unsigned int head = control->message_head;
+	struct apptree_message *message;
+	int count;
+	
+	for (count = 0; count < APPTREE_MESSAGE_QUEUE_SIZE; count++) {
+		if (head == control->message_tail)
+			break;
+		
+		APPTREE_MEMORY_BARRIER();
+		message = &control->messages[head & (APPTREE_MESSAGE_QUEUE_SIZE - 1)];
+		if (apptree_validate_message(control->tree, message) == 0)
+			apptree_apply_message(control, message);
+		APPTREE_MEMORY_BARRIER();
+		control->message_head = ++head;
+	}
+	
+	return count;
 }
 
-/** @brief Handles a "down" input
+/** @brief Drops the posted messages of nodes which have been removed
+ *	@param control The apptree session.
+ *
+ *	Called before removed nodes are freed, so that no message in the queue
+ *	is left pointing at them. Only the messages already posted are touched,
+ *	and each of them is left in place with no node, to be skipped once it is
+ *	reached, so the producers are not held up.
  */
-static void apptree_handle_down_input(void)
+static void apptree_drop_messages(struct apptree_control *control)
 {
-	apptree_increase_select_pos();
-	apptree_adjust_frame_pos();
-	apptree_print_menu();
+	unsigned int head = control->message_head;
+	unsigned int tail = control->message_tail;
+	struct apptree_message *message;
+	
+	APPTREE_MEMORY_BARRIER();
+	for (; head != tail; head++) {
+		message = &control->messages[head & (APPTREE_MESSAGE_QUEUE_SIZE - 1)];
+		if (message->node && (message->node->tree != control->tree))
+			message->node = NULL;
+	}
 }
+#endif
 
-/** @brief Handles a "select" input
+/** @}*/
+
+
+/* -------------------------------------------------------------------------- */
+/** @name Update Functions
+ *	Changes a tree while it is shown. Any number of changes are made between
+ *	apptree_begin_update and apptree_commit_update, during which nothing is
+ *	printed and no input is handled, and the menu is printed at most once
+ *	when the update is committed. Titles, infos and selections are changed
+ *	in place. Nodes may also be added with the setup functions and removed
+ *	with apptree_remove_node, in which case the child index and selections
+ *	are rebuilt once when the update is committed.
+ */
+/** @{*/
+
+/** @brief Checks whether nodes may be added to or removed from the tree
+ *	@param control The apptree session.
+ *	@returns 0 if they may be and -1 if otherwise.
+ *
+ *	Nodes may be added to a tree which is not frozen, or within an update. The
+ *	first change of the structure within an update copies the selections of
+ *	the children of every Single and Multi Selection node back into their
+ *	selected flags, from which they are tracked again once the child index
+ *	is rebuilt. Constant trees cannot be changed, nor can frozen trees which
+ *	are shown by more than one session, as the other sessions would keep on
+ *	showing the child index they had.
  */
-static void apptree_handle_select_input(void)
+static int apptree_open_structure(struct apptree_control *control)
 {
-	struct list_head *head;
-	struct apptree_node *child;
+	struct apptree_tree *tree = control->tree;
+	
+	if ((tree == NULL) || (tree->master->tree != tree))
+		return -1;
+	
+	if (!tree->frozen)
+		return 0;
+	
+	if ((control->update_depth == 0) || (tree->num_sessions > 1))
+		return -1;
+	
+	if (!control->update_structure) {
+		apptree_thaw_selection(tree->master);
+		control->update_structure = true;
+	}
 	
-	head = list_travese_to_index(&control.current->list_parent,
-									control.select_pos);
-	child = container_of(head, struct apptree_node, list_child);
+	return 0;
+}
 
-	if (child->num_child > 0) {	
-		control.current = child;
+/** @brief Copies the selections of the descendants of a node into their
+ *	selected flags
+ *	@param node The node.
+ */
+static void apptree_thaw_selection(struct apptree_node *node)
+{
+	int i;
+	
+	for (i = 0; i < (int)node->num_child; i++) {
+		if (node->mode != APPTREE_MODE_SIMPLE)
+			node->children[i]->state->selected = apptree_is_selected(node, i);
 		
-		control.picture_height = control.current->num_child;
-		control.frame_pos = 0;
-		control.select_pos = 0;
+		apptree_thaw_selection(node->children[i]);
+	}
+}
+
+/** @brief Sizes up a node and its descendants as they are chained
+ *	@param node The node.
+ *	@param words Handle for adding up the selection words needed.
+ *	@param parents Handle for adding up the parent states needed.
+ *	@returns 0 if successful and -1 if a node has too many children.
+ */
+static int apptree_measure_tree(struct apptree_node *node, int *words,
+								int *parents)
+{
+	struct apptree_node *child;
+	long count = 0;
+	
+	for (child = node->last_child; child; child = child->prev_sibling) {
+		if (apptree_measure_tree(child, words, parents))
+			return -1;
+		count++;
+	}
+	
+	if (count > APPTREE_MAX_CHILDREN)
+		return -1;
+	
+	if ((node->mode != APPTREE_MODE_SIMPLE) && (count > 0))
+		(*parents)++;
+	
+	if (node->mode == APPTREE_MODE_MULTI_SELECTION)
+		*words += APPTREE_SELECTION_WORDS(count);
+	
+	return 0;
+}
+
+/** @brief Counts the children of a node and its descendants as they are
+ *	chained, and moves their states out of their parent states
+ *	@param node The node.
+ */
+static void apptree_relink_tree(struct apptree_node *node)
+{
+	struct apptree_node *child;
+	int count = 0;
+	
+	for (child = node->last_child; child; child = child->prev_sibling) {
+		apptree_relink_tree(child);
+		count++;
+	}
+	
+	node->num_child = count;
+	if (node->state != &node->state_storage) {
+		node->state_storage = *node->state;
+		node->state			= &node->state_storage;
+	}
+}
+
+/** @brief Detaches a node and its descendants from the tree
+ *	@param node The node.
+ *	@returns The number of nodes detached.
+ */
+static int apptree_detach_nodes(struct apptree_node *node)
+{
+	struct apptree_node *child;
+	int count = 1;
+	
+	node->tree = NULL;
+	
+	for (child = node->last_child; child; child = child->prev_sibling)
+		count += apptree_detach_nodes(child);
+	
+	return count;
+}
+
+/** @brief Frees a node and its descendants
+ *	@param node The node, which was allocated from the heap.
+ */
+static void apptree_free_nodes(struct apptree_node *node)
+{
+	struct apptree_node *child = node->last_child;
+	struct apptree_node *prev;
+	
+	while (child) {
+		prev = child->prev_sibling;
+		apptree_free_nodes(child);
+		child = prev;
+	}
+	
+	free(node);
+}
+
+/** @brief Rebuilds the tree after nodes have been added or removed
+ *	@param control The apptree session.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	The storage for the child index, selections and sorted children is taken
+ *	first, so that the tree is left as it was shown should it run out. The
+ *	index is then laid out again from the chains of children.
+ *
+ *	Should the current node have been removed, its closest remaining ancestor
+ *	is shown instead. Otherwise the frame and select arrow are pulled back
+ *	within its remaining children, if it has any left. The path is dropped,
+ *	as the positions it holds may have moved, and all cached rows are
+ *	outdated, as they may belong to removed nodes.
+ */
+static int apptree_rebuild_tree(struct apptree_control *control)
+{
+	struct apptree_tree *tree = control->tree;
+	struct apptree_node **index = NULL;
+	uint32_t *selection = NULL;
+	struct apptree_parent_state *records = NULL;
+	struct apptree_node *node;
+	bool failed;
+	int words = 0;
+	int parents = 0;
+#if APPTREE_TYPE_AHEAD
+	int *sorted = NULL;
+#endif
+	
+	if (apptree_measure_tree(tree->master, &words, &parents))
+		return -1;
+	
+	if (tree->pool) {
+		if (words > tree->pool->selection_size)
+			return -1;
 		
-		apptree_resize_picture();
-		apptree_populate_picture();
-		apptree_print_menu();
+		index	  = tree->pool->index;
+		selection = tree->pool->selection;
+		records	  = tree->pool->parents;
+#if APPTREE_TYPE_AHEAD
+		sorted	  = tree->pool->sorted;
+#endif
 	} else {
-		if(child->function) {
-			child->function(control.current, control.select_pos);
-			apptree_update_selected(control.current, control.select_pos);
-			apptree_print_menu();
+#if APPTREE_STATS
+		tree->allocations += 3 + APPTREE_TYPE_AHEAD;
+#endif
+		index = malloc((tree->num_nodes - 1) * sizeof(struct apptree_node *));
+		selection = malloc(words * sizeof(uint32_t));
+		records = malloc(parents * sizeof(struct apptree_parent_state));
+		failed = ((index == NULL) && (tree->num_nodes > 1)) ||
+					((selection == NULL) && (words > 0)) ||
+					((records == NULL) && (parents > 0));
+#if APPTREE_TYPE_AHEAD
+		sorted = malloc((tree->num_nodes - 1) * sizeof(int));
+		failed = failed || ((sorted == NULL) && (tree->num_nodes > 1));
+#endif
+		if (failed) {
+			free(index);
+			free(selection);
+			free(records);
+#if APPTREE_TYPE_AHEAD
+			free(sorted);
+#endif
+			return -1;
 		}
 	}
+	
+	/* The states are moved out of the old parent states before they go */
+	apptree_relink_tree(tree->master);
+	
+	if (tree->pool == NULL) {
+		free(tree->index);
+		free(tree->selection);
+		free(tree->parents);
+		tree->index		= index;
+		tree->selection = selection;
+		tree->parents	= records;
+#if APPTREE_TYPE_AHEAD
+		free(tree->sorted);
+		tree->sorted	= sorted;
+#endif
+	}
+	
+	apptree_index_node(tree->master, index);
+	apptree_track_selection(tree->master, &selection, &records);
+#if APPTREE_TYPE_AHEAD
+	apptree_sort_node(tree->master, sorted);
+#endif
+#if APPTREE_ROW_CACHE_SIZE
+	tree->generation++;
+#endif
+	
+	if (control->current->tree != tree) {
+		for (node = control->current; node->tree != tree; node = node->parent)
+			;
+		
+		control->current	= node;
+		control->frame_pos	= 0;
+		control->select_pos	= 0;
+	}
+	
+#if APPTREE_PATH_DEPTH
+	control->path_len = 0;
+#endif
+	
+#if APPTREE_MESSAGE_QUEUE_SIZE
+	apptree_drop_messages(control);
+#endif
+	while (control->removed) {
+		node = control->removed;
+		control->removed = node->prev_sibling;
+		if (tree->pool == NULL)
+			apptree_free_nodes(node);
+	}
+	
+	if (control->enabled) {
+		control->picture = control->current->children;
+		apptree_refresh_picture(control);
+		control->redraw = true;
+	}
+	
+	return 0;
 }
 
-/** @brief Handles a "back" input.
+/** @brief Begins an update of the tree
+ *	@param control The apptree session.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	Updates may be nested, in which case only the outermost commit prints
+ *	the menu.
  */
-static void apptree_handle_back_input(void)
+int apptree_begin_update(struct apptree_control *control)
 {
-	if (control.current == control.master)
-		return;
-	
-	control.current = control.current->parent;
+	if (control->tree == NULL)
+		return -1;
 	
-	control.picture_height = control.current->num_child;
-	control.frame_pos = 0;
-	control.select_pos = 0;
+	control->update_depth++;
+	return 0;
+}
 
-	apptree_resize_picture();
-	apptree_populate_picture();
-	apptree_print_menu();
+/** @brief Changes a node within an update
+ *	@param control The apptree session.
+ *	@param change The change, as it would be posted with
+ *	apptree_post_message.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	The change is applied at once, but the menu is only printed once the
+ *	update is committed, and only if the change shows. A new title only
+ *	outdates the cached rows of the parent.
+ *
+ *	@note The nodes of a constant tree keep their title and info in read-only
+ *	memory, so APPTREE_MESSAGE_TITLE and APPTREE_MESSAGE_INFO are refused for
+ *	them.
+ */
+int apptree_update_node(struct apptree_control *control,
+						const struct apptree_message *change)
+{
+	struct apptree_tree *tree = control->tree;
+	
+	if ((control->update_depth == 0) || apptree_validate_message(tree, change))
+		return -1;
+	
+	apptree_apply_message(control, change);
+	return 0;
 }
 
-/** @brief Handles a "home" input.
+/** @brief Removes a node and its descendants from the tree
+ *	@param control The apptree session.
+ *	@param node The node to be removed, which must not be the master.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	Nodes may be removed while the tree is set up, or within an update. The
+ *	nodes of a frozen tree are freed once the update is committed, as the
+ *	child index keeps on showing them until then. Nodes taken from a pool are not
+ *	handed out again. Nodes cannot be removed from a frozen tree which is
+ *	shown by more than one session. Messages still queued for the removed
+ *	nodes are dropped before they are freed.
+ *
+ *	@note Handles to the removed nodes become invalid once the update is
+ *	committed, or at once if the tree is not frozen yet, and must not be
+ *	posted to or changed after that.
  */
-static void apptree_handle_home_input(void)
+int apptree_remove_node(struct apptree_control *control,
+						struct apptree_node *node)
 {
-	if (control.current == control.master)
-		return;
+	struct apptree_tree *tree = control->tree;
+	struct apptree_node **link;
+	struct apptree_node *parent;
+	
+	if (apptree_open_structure(control))
+		return -1;
+	
+	if (apptree_validate_node(tree, node) || (node == tree->master))
+		return -1;
+	
+	parent = node->parent;
+	for (link = &parent->last_child; *link != node;
+			link = &(*link)->prev_sibling)
+		;
 	
-	control.current = control.master;
+	*link = node->prev_sibling;
+	tree->num_nodes -= apptree_detach_nodes(node);
+	
+	if (!tree->frozen) {
+		parent->num_child--;
+#if APPTREE_MESSAGE_QUEUE_SIZE
+		apptree_drop_messages(control);
+#endif
+		if (tree->pool == NULL)
+			apptree_free_nodes(node);
+		return 0;
+	}
 	
-	control.picture_height = control.current->num_child;
-	control.frame_pos = 0;
-	control.select_pos = 0;
+	node->prev_sibling = control->removed;
+	control->removed = node;
+	return 0;
+}
 
-	apptree_resize_picture();
-	apptree_populate_picture();
-	apptree_print_menu();
+/** @brief Commits an update of the tree
+ *	@param control The apptree session.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	If nodes have been added or removed, the child index and selections are
+ *	rebuilt, which fails if the heap or the pool runs out. The update is then
+ *	left open with the tree as it was last shown, and the commit may be tried
+ *	again once nodes have been removed or memory has been freed. Otherwise
+ *	the menu is printed if any change shows, or left to apptree_tick with a
+ *	frame limit.
+ *	Inputs which arrived during the update are handled by the next call to
+ *	apptree_handle_input.
+ */
+int apptree_commit_update(struct apptree_control *control)
+{
+	if (control->update_depth == 0)
+		return -1;
+	
+	if (control->update_depth > 1) {
+		control->update_depth--;
+		return 0;
+	}
+	
+	if (control->update_structure) {
+		if (apptree_rebuild_tree(control))
+			return -1;
+		
+		control->update_structure = false;
+	}
+	
+	control->update_depth = 0;
+	if (control->enabled && control->redraw)
+		apptree_schedule_menu(control);
+	
+	return 0;
 }
 
-/** @brief Handles user inputs
- *	@returns 0 if a new input is detected and -1 if otherwise.
+/** @}*/
+
+
+/* -------------------------------------------------------------------------- */
+/** @name Instrumentation Functions
+ *	Counts the work done by an apptree session, so that a slow display can be
+ *	told apart from a slow driver. The counters are only built in when
+ *	APPTREE_STATS is set as 1.
+ */
+/** @{*/
+
+/** @brief Binds the function timing apptree_handle_input.
+ *	@param control The apptree session.
+ *	@param timestamp Function returning a free running count, such as
+ *	apptree_cycles_read, or NULL to stop timing.
+ *	@returns 0 if successful and -1 if otherwise.
  *
- *	This function checks for a user input and handles it according to the
- *	binded key values.
+ *	Each call to apptree_handle_input which handles an input or a message is
+ *	timed from start to end, and the time is recorded in the input_time
+ *	histogram of the stats. The count is allowed to wrap around.
  */
-int apptree_handle_input(void)
+int apptree_set_timestamp(struct apptree_control *control,
+							uint32_t (*timestamp)(void))
 {
-	char input;
+#if APPTREE_STATS
+	if (control->tree == NULL)
+		return -1;
 	
-	if (!control.enabled)
+	control->timestamp = timestamp;
+	return 0;
+#else
+	(void)control;
+	(void)timestamp;
+	return -1;
+#endif
+}
+
+/** @brief Gets the counters of a session.
+ *	@param control The apptree session.
+ *	@param stats Struct receiving a copy of the counters.
+ *	@returns 0 if successful and -1 if otherwise.
+ *
+ *	The allocations are counted for the tree, so they are shared by every
+ *	session showing it.
+ */
+int apptree_get_stats(struct apptree_control *control,
+						struct apptree_stats *stats)
+{
+#if APPTREE_STATS
+	if ((control->tree == NULL) || (stats == NULL))
 		return -1;
 	
-	if (apptree_read(&input))
+	*stats = control->io.stats;
+	stats->allocations = control->tree->allocations;
+	return 0;
+#else
+	(void)control;
+	(void)stats;
+	return -1;
+#endif
+}
+
+/** @brief Clears the counters of a session.
+ *	@param control The apptree session.
+ *	@returns 0 if successful and -1 if otherwise.
+ */
+int apptree_reset_stats(struct apptree_control *control)
+{
+#if APPTREE_STATS
+	if (control->tree == NULL)
 		return -1;
 	
-	if (input == control.keys->up) {
-		apptree_handle_up_input();
-	} else if (input == control.keys->down) {
-		apptree_handle_down_input();
-	} else if (input == control.keys->select) {
-		apptree_handle_select_input();
-	} else if (input == control.keys->back) {
-		apptree_handle_back_input();
-	} else if (input == control.keys->home) {
-		apptree_handle_home_input();
+	memset(&control->io.stats, 0, sizeof(control->io.stats));
+	control->io.stats_skipped = 0;
+	control->tree->allocations = 0;
+	return 0;
+#else
+	(void)control;
+	return -1;
+#endif
+}
+
+#if APPTREE_STATS
+/** @brief Records the time taken to handle an input
+ *	@param control The apptree session.
+ *	@param start The timestamp taken when the handling started.
+ *
+ *	The time is counted in the bucket of its binary logarithm, which takes a
+ *	few shifts instead of any divisions.
+ */
+static void apptree_record_time(struct apptree_control *control,
+								uint32_t start)
+{
+	uint32_t time;
+	int bucket = 0;
+	
+	if (control->timestamp == NULL)
+		return;
+	
+	time = control->timestamp() - start;
+	
+	while ((time != 0) && (bucket < (APPTREE_STATS_BUCKETS - 1))) {
+		time >>= 1;
+		bucket++;
 	}
 	
-	return 0;
+	control->io.stats.input_time[bucket]++;
 }
+#endif
 
 /** @}*/
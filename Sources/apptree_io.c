@@ -9,65 +9,996 @@
 #include <string.h>
 #include "apptree_io.h"
 
-static char *convert(unsigned int num, int base);
+static int convert_dec(unsigned int num, char *buff);
+static int convert_pow2(unsigned int num, int shift, char *buff);
+static void apptree_put_number(struct apptree_io_control *control,
+								const char *digits, int len, char sign,
+								int width, bool zero_pad);
+static void apptree_write_n(struct apptree_io_control *control,
+							const char *s, size_t len);
+static void apptree_write_staged(struct apptree_io_control *control,
+									size_t len);
+static void apptree_terminal_begin_row(struct apptree_io_control *control,
+										int row);
+static void apptree_terminal_draw(struct apptree_io_control *control,
+									const struct apptree_iovec *iov,
+									int count);
+static void apptree_terminal_end_row(struct apptree_io_control *control);
+static void apptree_terminal_flush(struct apptree_io_control *control);
+static void apptree_framebuffer_fill(struct apptree_io_control *control,
+										const char *s, int len);
+static void apptree_framebuffer_begin_row(struct apptree_io_control *control,
+											int row);
+static void apptree_framebuffer_draw(struct apptree_io_control *control,
+										const struct apptree_iovec *iov,
+										int count);
+static void apptree_framebuffer_end_row(struct apptree_io_control *control);
+static void apptree_framebuffer_flush(struct apptree_io_control *control);
+static void apptree_null_begin_row(struct apptree_io_control *control,
+									int row);
+static void apptree_null_draw(struct apptree_io_control *control,
+								const struct apptree_iovec *iov, int count);
+static void apptree_null_finish(struct apptree_io_control *control);
+#if APPTREE_DIFF_RENDER
+static void apptree_capture(struct apptree_io_control *control, char c);
+static void apptree_goto(struct apptree_io_control *control,
+							int line, int column);
+static void apptree_write_line(struct apptree_io_control *control);
+#endif
+#if APPTREE_INPUT_QUEUE_SIZE
+static int apptree_take_input(struct apptree_io_control *control,
+								char *input);
+#endif
 
-static struct apptree_io_control control;
+/** Streams the menu to a terminal through the binded writers. This is the
+ *	default display, and the only one which supports the diff render mode.
+ */
+const struct apptree_display apptree_terminal_display = {
+	apptree_terminal_begin_row,
+	apptree_terminal_draw,
+	apptree_terminal_end_row,
+	apptree_terminal_flush
+};
+
+/** Writes the rows of the menu straight into the display RAM set with
+ *	apptree_io_set_framebuffer, such as that of a character LCD
+ */
+const struct apptree_display apptree_framebuffer_display = {
+	apptree_framebuffer_begin_row,
+	apptree_framebuffer_draw,
+	apptree_framebuffer_end_row,
+	apptree_framebuffer_flush
+};
+
+/** Discards the menu, which leaves only the cost of navigating the tree */
+const struct apptree_display apptree_null_display = {
+	apptree_null_begin_row,
+	apptree_null_draw,
+	apptree_null_finish,
+	apptree_null_finish
+};
 
 /** Initialize the apptree_io
+ *	@param control The io control.
  *	@param read_input Function for reading an input char.
  *	@param write_output Function for writing an output char.
  */
-void apptree_io_init(int (*read_input)(char *input),
+void apptree_io_init(struct apptree_io_control *control,
+						int (*read_input)(char *input),
 						void (*write_output)(char output))
 {
-	control.read_input	 = read_input;
-	control.write_output = write_output;
+	control->read_input	  = read_input;
+	control->write_output = write_output;
+	control->write_block  = NULL;
+	control->write_vector = NULL;
+	control->rx_head	  = 0;
+	control->rx_count	  = 0;
+	control->tx_len		  = 0;
+	control->tx_pos		  = 0;
+	control->deferred	  = false;
+	control->display	  = &apptree_terminal_display;
+	control->fb_ram		  = NULL;
+	control->fb_width	  = 0;
+	control->fb_height	  = 0;
+	control->fb_row		  = 0;
+	control->fb_first_dirty = 0;
+	control->fb_last_dirty = -1;
+	control->fb_refresh	  = NULL;
+	
+#if APPTREE_DIFF_RENDER
+	control->diff_render  = false;
+	control->goto_line	  = NULL;
+	control->scroll_region = false;
+	control->shadow_valid = false;
+	control->capture	  = false;
+#endif
+
+#if APPTREE_INPUT_QUEUE_SIZE
+	control->input_head	  = 0;
+	control->input_tail	  = 0;
+#endif
+
+#if APPTREE_STATS
+	memset(&control->stats, 0, sizeof(control->stats));
+	control->stats_skipped = 0;
+#endif
+}
+
+/** Binds a block writer to the apptree_io
+ *	@param control The io control.
+ *	@param write_block Function for writing a block of output chars. Pass NULL
+ *	to go back to writing one char at a time.
+ *
+ *	Any output still held in the staging buffer is flushed before the writer
+ *	is changed.
+ */
+void apptree_io_set_write_block(struct apptree_io_control *control,
+								void (*write_block)(const char *buf,
+													size_t len))
+{
+	apptree_flush(control);
+	control->write_block = write_block;
+}
+
+/** Binds a vectored writer to the apptree_io
+ *	@param control The io control.
+ *	@param write_vector Function for writing a list of segments. Pass NULL to
+ *	go back to writing through write_block or write_output.
+ *
+ *	Any output still held in the staging buffer is flushed before the writer
+ *	is changed.
+ */
+void apptree_io_set_write_vector(struct apptree_io_control *control,
+									void (*write_vector)(
+								const struct apptree_iovec *iov, int count))
+{
+	apptree_flush(control);
+	control->write_vector = write_vector;
+}
+
+/** Enables or disables deferred output
+ *	@param control The io control.
+ *	@param deferred Set as true to keep outputs in the tx buffer until they
+ *	are drained with apptree_io_drain.
+ *
+ *	While output is deferred, nothing is written to the output media from
+ *	within apptree_putc as long as the outputs fit into the tx buffer. Should
+ *	an output not fit, the buffer is written right away rather than dropping
+ *	any output, which is counted in the overflows of the stats. Any deferred
+ *	output is flushed when this mode is disabled.
+ */
+void apptree_io_set_deferred(struct apptree_io_control *control, bool deferred)
+{
+	control->deferred = deferred;
+	
+	if (!deferred)
+		apptree_flush(control);
+}
+
+/** Enables or disables the diff render mode
+ *	@param control The io control.
+ *	@param enable Set as true to only write lines which have changed.
+ *	@param goto_line Function for moving the cursor to the start of a line.
+ *	Pass NULL to use VT100 escape sequences.
+ *
+ *	The shadow is invalidated, so the next menu is written in full.
+ */
+void apptree_io_set_diff_render(struct apptree_io_control *control,
+								bool enable, void (*goto_line)(int line))
+{
+#if APPTREE_DIFF_RENDER
+	control->diff_render  = enable;
+	control->goto_line	  = goto_line;
+	control->shadow_valid = false;
+#else
+	(void)control;
+	(void)enable;
+	(void)goto_line;
+#endif
+}
+
+/** Enables or disables scrolling with VT100 scroll regions
+ *	@param control The io control.
+ *	@param enable Set as true to shift the lines of a region scrolled with
+ *	apptree_io_scroll on the terminal, instead of writing them again.
+ *
+ *	Only takes effect in diff render mode without a goto_line function, as
+ *	the terminal has to understand VT100 escape sequences.
+ */
+void apptree_io_set_scroll_region(struct apptree_io_control *control,
+									bool enable)
+{
+#if APPTREE_DIFF_RENDER
+	control->scroll_region = enable;
+#else
+	(void)control;
+	(void)enable;
+#endif
+}
+
+/** Binds a display backend to the apptree_io
+ *	@param control The io control.
+ *	@param display The display through which the menu is drawn.
+ *
+ *	The previous display is flushed before it is changed. In diff render
+ *	mode, the shadow is invalidated, so the terminal is drawn in full when it
+ *	is binded again.
+ */
+void apptree_io_set_display(struct apptree_io_control *control,
+							const struct apptree_display *display)
+{
+	control->display->flush(control);
+	control->display = display;
+	
+#if APPTREE_DIFF_RENDER
+	control->shadow_valid = false;
+#endif
 }
 
-/** @brief Converts the number base of an integer
+/** Binds a framebuffer as the display of the apptree_io
+ *	@param control The io control.
+ *	@param ram The display RAM, holding height rows of width characters
+ *	without any terminators.
+ *	@param width The number of characters in a row.
+ *	@param height The number of rows.
+ *	@param refresh Optional function called on each flush with the range of
+ *	rows which have changed, for instance to send them to the display.
+ *
+ *	The display RAM is cleared with spaces. Characters beyond the width and
+ *	rows beyond the height of the display are left out.
+ */
+void apptree_io_set_framebuffer(struct apptree_io_control *control,
+								char *ram, int width, int height,
+								void (*refresh)(int first_row,
+												int last_row))
+{
+	apptree_io_set_display(control, &apptree_framebuffer_display);
+	
+	control->fb_ram			= ram;
+	control->fb_width		= width;
+	control->fb_height		= height;
+	control->fb_row			= height;
+	control->fb_column		= 0;
+	control->fb_row_dirty	= false;
+	control->fb_refresh		= refresh;
+	
+	memset(ram, ' ', (size_t)width * height);
+	control->fb_first_dirty = 0;
+	control->fb_last_dirty	= height - 1;
+}
+
+/** @brief Converts an integer into decimal digits
+ *	@param num The integer to be converted.
+ *	@param buff Buffer of at least APPTREE_NUMBER_SIZE chars for the digits.
+ *	@returns Returns the number of digits.
+ *
+ *	Each digit is found by subtracting powers of ten, which avoids divisions
+ *	on cores without a hardware divider.
+ */
+static int convert_dec(unsigned int num, char *buff)
+{
+	static const unsigned long powers[] = {
+		1000000000UL, 100000000UL, 10000000UL, 1000000UL, 100000UL,
+		10000UL, 1000UL, 100UL, 10UL, 1UL
+	};
+	unsigned long rest = num;
+	int i, len = 0;
+	char digit;
+	
+	for (i = 0; i < (int)(sizeof(powers) / sizeof(powers[0])); i++) {
+		digit = '0';
+		while (rest >= powers[i]) {
+			rest -= powers[i];
+			digit++;
+		}
+		
+		if ((digit != '0') || (len > 0) || (powers[i] == 1))
+			buff[len++] = digit;
+	}
+	
+	return len;
+}
+
+/** @brief Formats an integer as decimal digits
+ *	@param num The integer to be formatted.
+ *	@param width The minimum number of chars, padded with spaces ahead of the
+ *	digits. It is limited to APPTREE_NUMBER_SIZE.
+ *	@param buff Buffer of at least APPTREE_NUMBER_SIZE chars for the result.
+ *	@returns Returns the number of chars in buff, which is not terminated.
+ */
+int apptree_format_dec(unsigned int num, int width, char *buff)
+{
+	char digits[APPTREE_NUMBER_SIZE];
+	int len, pad;
+	
+	if (width > (int)APPTREE_NUMBER_SIZE)
+		width = APPTREE_NUMBER_SIZE;
+	
+	len = convert_dec(num, digits);
+	pad = (width > len) ? (width - len) : 0;
+	
+	memset(buff, ' ', pad);
+	memcpy(&buff[pad], digits, len);
+	
+	return pad + len;
+}
+
+/** @brief Converts an integer into octal or hexadecimal digits
  *	@param num The integer to be converted.
- *	@param base The base to be converted into.
- *	@returns Returns the result as a string format.
+ *	@param shift Number of bits per digit, 3 for octal and 4 for hexadecimal.
+ *	@param buff Buffer of at least APPTREE_NUMBER_SIZE chars for the digits.
+ *	@returns Returns the number of digits.
  */
-static char *convert(unsigned int num, int base)
+static int convert_pow2(unsigned int num, int shift, char *buff)
 {
-	static char buff[10];
-	char *ptr;
-	ptr = &buff[sizeof(buff)-1];
-	*ptr = '\0';
+	unsigned int mask = (1u << shift) - 1;
+	unsigned int rest = num;
+	int i, len = 0;
+	
 	do {
-		*--ptr = "0123456789abcdef"[num%base];
-		num /= base;
-	} while (num != 0);
-	return(ptr);
+		len++;
+		rest >>= shift;
+	} while (rest != 0);
+	
+	for (i = len - 1; i >= 0; i--) {
+		buff[i] = "0123456789abcdef"[num & mask];
+		num >>= shift;
+	}
+	
+	return len;
+}
+
+/** @brief Writes a converted number to output
+ *	@param control The io control.
+ *	@param digits The digits of the number.
+ *	@param len The number of digits.
+ *	@param sign The sign to be written ahead of the digits, or 0 for none.
+ *	@param width The minimum number of chars to be written, including the sign.
+ *	@param zero_pad Set as true to pad with zeros after the sign instead of
+ *	with spaces ahead of it.
+ */
+static void apptree_put_number(struct apptree_io_control *control,
+								const char *digits, int len, char sign,
+								int width, bool zero_pad)
+{
+	int i, pad;
+	
+	pad = width - len - (sign ? 1 : 0);
+	
+	if (!zero_pad)
+		for (i = 0; i < pad; i++)
+			apptree_putc(control, ' ');
+	
+	if (sign)
+		apptree_putc(control, sign);
+	
+	if (zero_pad)
+		for (i = 0; i < pad; i++)
+			apptree_putc(control, '0');
+	
+	for (i = 0; i < len; i++)
+		apptree_putc(control, digits[i]);
+}
+
+/** @brief Writes a block of chars to the output media
+ *	@param control The io control.
+ *	@param s The chars to be written.
+ *	@param len The number of chars in s.
+ *
+ *	Redirects the output to the write_output function in the control struct,
+ *	or to the write_vector function as a single segment if it is binded. If a
+ *	block writer is binded, the chars are staged in the tx buffer instead with
+ *	as few copies as possible, and only written once the buffer is full or
+ *	flushed. Deferred outputs are always staged, with the written part of the
+ *	buffer reclaimed first and the buffer flushed only once it is all unread.
+ */
+static void apptree_write_n(struct apptree_io_control *control,
+							const char *s, size_t len)
+{
+	struct apptree_iovec iov;
+	size_t i, n;
+	
+	if ((control->write_block == NULL) && !control->deferred) {
+		if (control->write_vector && (len > 1)) {
+			iov.base = s;
+			iov.len	 = len;
+			control->write_vector(&iov, 1);
+			APPTREE_STATS_ADD(control, writes, 1);
+			APPTREE_STATS_ADD(control, bytes, len);
+			return;
+		}
+		
+		for (i = 0; i < len; i++)
+			control->write_output(s[i]);
+		APPTREE_STATS_ADD(control, writes, len);
+		APPTREE_STATS_ADD(control, bytes, len);
+		return;
+	}
+	
+	while (len > 0) {
+		if (control->deferred && (control->tx_len == APPTREE_TX_BUFFER_SIZE) &&
+			(control->tx_pos > 0)) {
+			control->tx_len -= control->tx_pos;
+			memmove(control->tx_buffer, &control->tx_buffer[control->tx_pos],
+					control->tx_len);
+			control->tx_pos = 0;
+		}
+		
+		if (control->tx_len == APPTREE_TX_BUFFER_SIZE) {
+			if (control->deferred)
+				APPTREE_STATS_ADD(control, overflows, 1);
+			
+			apptree_flush(control);
+		}
+		
+		n = APPTREE_TX_BUFFER_SIZE - control->tx_len;
+		if (n > len)
+			n = len;
+		
+		memcpy(&control->tx_buffer[control->tx_len], s, n);
+		control->tx_len += n;
+		s	+= n;
+		len -= n;
+	}
+}
+
+/** @brief Writes staged chars to the output media
+ *	@param control The io control.
+ *	@param len The number of chars to be written from the tx buffer.
+ */
+static void apptree_write_staged(struct apptree_io_control *control,
+									size_t len)
+{
+	size_t i;
+	
+	if (len == 0)
+		return;
+	
+	if (control->write_block) {
+		control->write_block(&control->tx_buffer[control->tx_pos], len);
+		APPTREE_STATS_ADD(control, writes, 1);
+	} else {
+		for (i = 0; i < len; i++)
+			control->write_output(control->tx_buffer[control->tx_pos + i]);
+		APPTREE_STATS_ADD(control, writes, len);
+	}
+	APPTREE_STATS_ADD(control, bytes, len);
+	
+	control->tx_pos += len;
+	if (control->tx_pos == control->tx_len) {
+		control->tx_pos = 0;
+		control->tx_len = 0;
+	}
 }
 
 /** @brief Writes a char to output
+ *	@param control The io control.
  *	@param c The character to be written.
  *
- *	Redirects the output from a char to the write_output function in the
- *	control struct.
+ *	Draws the char on the binded display.
  */
-void apptree_putc(char c)
+void apptree_putc(struct apptree_io_control *control, char c)
 {
-	control.write_output(c);
+	struct apptree_iovec iov;
+	
+	iov.base = &c;
+	iov.len	 = 1;
+	control->display->draw(control, &iov, 1);
 }
 
 /** @brief Writes a string to output
+ *	@param control The io control.
  *	@param s The string of characters to be written.
  *
- *	Redirects the output from a string to the write_output function in the
- *	control struct.
+ *	Draws the string on the binded display.
+ */
+void apptree_puts(struct apptree_io_control *control, char *s)
+{
+	apptree_putn(control, s, strlen(s));
+}
+
+/** @brief Writes a string of known length to output
+ *	@param control The io control.
+ *	@param s The string of characters to be written.
+ *	@param len The number of characters in s.
+ */
+void apptree_putn(struct apptree_io_control *control, const char *s, size_t len)
+{
+	struct apptree_iovec iov;
+	
+	iov.base = s;
+	iov.len	 = len;
+	control->display->draw(control, &iov, 1);
+}
+
+/** @brief Writes a list of segments to output
+ *	@param control The io control.
+ *	@param iov The segments to be written in order.
+ *	@param count The number of segments in iov.
+ *
+ *	Hands the segments to the binded display in a single call.
+ */
+void apptree_putv(struct apptree_io_control *control,
+					const struct apptree_iovec *iov, int count)
+{
+	control->display->draw(control, iov, count);
+}
+
+/** @brief Flushes the tx buffer
+ *	@param control The io control.
+ *
+ *	Hands all staged output over to the write_block function in a single
+ *	call, or to the write_output function if output is deferred without a
+ *	block writer. Does nothing if there is no staged output.
+ */
+void apptree_flush(struct apptree_io_control *control)
+{
+	apptree_write_staged(control, control->tx_len - control->tx_pos);
+}
+
+/** @brief Drains part of the tx buffer
+ *	@param control The io control.
+ *	@param budget The maximum number of chars to be written.
+ *	@returns The number of chars written.
+ */
+int apptree_io_drain(struct apptree_io_control *control, int budget)
+{
+	size_t len = control->tx_len - control->tx_pos;
+	
+	if (budget <= 0)
+		return 0;
+	
+	if (len > (size_t)budget)
+		len = budget;
+	
+	apptree_write_staged(control, len);
+	return len;
+}
+
+/** @brief Checks for staged output
+ *	@param control The io control.
+ *	@returns true if the tx buffer holds any output which is not yet written.
+ */
+bool apptree_io_pending(struct apptree_io_control *control)
+{
+	return control->tx_len > control->tx_pos;
+}
+
+/** @brief Begins a line of output
+ *	@param control The io control.
+ *	@param line The line, counted from 0 at the top of the display.
+ *
+ *	Moves the cursor of the binded display to the start of the line.
+ */
+void apptree_io_begin_line(struct apptree_io_control *control, int line)
+{
+	control->display->begin_row(control, line);
+}
+
+/** @brief Ends a line of output
+ *	@param control The io control.
+ *
+ *	Clears the rest of the line on the binded display.
+ */
+void apptree_io_end_line(struct apptree_io_control *control)
+{
+	control->display->end_row(control);
+}
+
+/** @brief Flushes the binded display
+ *	@param control The io control.
+ *
+ *	Pushes a complete menu to the binded display.
+ */
+void apptree_io_flush_display(struct apptree_io_control *control)
+{
+	control->display->flush(control);
+	
+#if APPTREE_STATS
+	if (control->stats.rows_skipped != control->stats_skipped)
+		control->stats.partial_redraws++;
+	else
+		control->stats.full_redraws++;
+	
+	control->stats_skipped = control->stats.rows_skipped;
+#endif
+}
+
+/** @brief Begins a line on the terminal
+ *	@param control The io control.
+ *	@param row The line, counted from 0 at the top of the terminal.
+ *
+ *	In diff render mode, all outputs up to the following apptree_io_end_line
+ *	are captured into the shadow of the line instead of being written.
+ */
+static void apptree_terminal_begin_row(struct apptree_io_control *control,
+										int row)
+{
+#if APPTREE_DIFF_RENDER
+	if (!control->diff_render)
+		return;
+	
+	control->capture	= true;
+	control->line		= row;
+	control->line_len	= 0;
+	control->line_first = TERMINAL_WIDTH;
+	control->line_last	= 0;
+#else
+	(void)control;
+	(void)row;
+#endif
+}
+
+/** @brief Writes a list of segments to the terminal
+ *	@param control The io control.
+ *	@param iov The segments to be written in order.
+ *	@param count The number of segments in iov.
+ *
+ *	While a line is being captured in diff render mode, the segments are
+ *	captured into the shadow. Otherwise more than one segment is handed to
+ *	the write_vector function in a single call if it is binded and output is
+ *	not deferred, and the segments are written one after another if not.
+ */
+static void apptree_terminal_draw(struct apptree_io_control *control,
+									const struct apptree_iovec *iov,
+									int count)
+{
+	int i;
+	
+#if APPTREE_DIFF_RENDER
+	size_t j;
+	
+	if (control->capture) {
+		for (i = 0; i < count; i++)
+			for (j = 0; j < iov[i].len; j++)
+				apptree_capture(control, iov[i].base[j]);
+		return;
+	}
+#endif
+	
+	if ((count > 1) && control->write_vector && !control->deferred) {
+		apptree_flush(control);
+		control->write_vector(iov, count);
+		APPTREE_STATS_ADD(control, writes, 1);
+		for (i = 0; i < count; i++)
+			APPTREE_STATS_ADD(control, bytes, iov[i].len);
+		return;
+	}
+	
+	for (i = 0; i < count; i++)
+		apptree_write_n(control, iov[i].base, iov[i].len);
+}
+
+/** @brief Ends a line on the terminal
+ *	@param control The io control.
+ *
+ *	Terminates the line with a line break. In diff render mode, the captured
+ *	line is only written if it differs from what was last written.
  */
-void apptree_puts(char *s)
+static void apptree_terminal_end_row(struct apptree_io_control *control)
 {
-	int i = 0;
+#if APPTREE_DIFF_RENDER
+	if (control->diff_render) {
+		control->capture = false;
+		apptree_write_line(control);
+		return;
+	}
+#endif
 	
-	while (s[i] != '\0')
-		control.write_output(s[i++]);
+	apptree_write_n(control, "\r\n", 2);
+	APPTREE_STATS_ADD(control, rows_drawn, 1);
 }
 
+/** @brief Flushes the terminal
+ *	@param control The io control.
+ *
+ *	Deferred output is left in the tx buffer to be drained.
+ */
+static void apptree_terminal_flush(struct apptree_io_control *control)
+{
+	if (!control->deferred)
+		apptree_flush(control);
+}
+
+/** @brief Writes chars at the framebuffer cursor
+ *	@param control The io control.
+ *	@param s The chars to be written, or NULL to write spaces.
+ *	@param len The number of chars to be written.
+ *
+ *	Chars beyond the end of the row are left out, and the row is only marked
+ *	as changed if a char differs from what the display RAM holds.
+ */
+static void apptree_framebuffer_fill(struct apptree_io_control *control,
+										const char *s, int len)
+{
+	char *ram;
+	char c;
+	int i;
+	
+	if (control->fb_row >= control->fb_height)
+		return;
+	
+	if (len > (control->fb_width - control->fb_column))
+		len = control->fb_width - control->fb_column;
+	
+	ram = &control->fb_ram[control->fb_row * control->fb_width +
+							control->fb_column];
+	for (i = 0; i < len; i++) {
+		c = s ? s[i] : ' ';
+		if (ram[i] != c) {
+			ram[i] = c;
+			control->fb_row_dirty = true;
+		}
+	}
+	
+	control->fb_column += len;
+}
+
+/** @brief Moves the framebuffer cursor to the start of a row
+ *	@param control The io control.
+ *	@param row The row, counted from 0 at the top of the display.
+ */
+static void apptree_framebuffer_begin_row(struct apptree_io_control *control,
+											int row)
+{
+	control->fb_row		  = row;
+	control->fb_column	  = 0;
+	control->fb_row_dirty = false;
+}
+
+/** @brief Copies a list of segments into the display RAM
+ *	@param control The io control.
+ *	@param iov The segments to be copied in order.
+ *	@param count The number of segments in iov.
+ */
+static void apptree_framebuffer_draw(struct apptree_io_control *control,
+										const struct apptree_iovec *iov,
+										int count)
+{
+	int i;
+	
+	for (i = 0; i < count; i++)
+		apptree_framebuffer_fill(control, iov[i].base, iov[i].len);
+}
+
+/** @brief Clears the rest of the framebuffer row with spaces
+ *	@param control The io control.
+ *
+ *	The row is added to the range of changed rows if any of it has changed.
+ */
+static void apptree_framebuffer_end_row(struct apptree_io_control *control)
+{
+	apptree_framebuffer_fill(control, NULL,
+								control->fb_width - control->fb_column);
+	
+	if (control->fb_row >= control->fb_height)
+		return;
+	
+	if (!control->fb_row_dirty) {
+		APPTREE_STATS_ADD(control, rows_skipped, 1);
+		return;
+	}
+	
+	if (control->fb_first_dirty > control->fb_row)
+		control->fb_first_dirty = control->fb_row;
+	if (control->fb_last_dirty < control->fb_row)
+		control->fb_last_dirty = control->fb_row;
+	
+	APPTREE_STATS_ADD(control, rows_drawn, 1);
+}
+
+/** @brief Hands the changed rows of the framebuffer to the refresh function
+ *	@param control The io control.
+ */
+static void apptree_framebuffer_flush(struct apptree_io_control *control)
+{
+	if (control->fb_first_dirty > control->fb_last_dirty)
+		return;
+	
+	if (control->fb_refresh)
+		control->fb_refresh(control->fb_first_dirty, control->fb_last_dirty);
+	
+	control->fb_first_dirty = control->fb_height;
+	control->fb_last_dirty	= -1;
+}
+
+/** @brief Ignores the start of a row
+ *	@param control The io control.
+ *	@param row The row.
+ */
+static void apptree_null_begin_row(struct apptree_io_control *control,
+									int row)
+{
+	(void)control;
+	(void)row;
+}
+
+/** @brief Ignores a list of segments
+ *	@param control The io control.
+ *	@param iov The segments.
+ *	@param count The number of segments in iov.
+ */
+static void apptree_null_draw(struct apptree_io_control *control,
+								const struct apptree_iovec *iov, int count)
+{
+	(void)control;
+	(void)iov;
+	(void)count;
+}
+
+/** @brief Ignores the end of a row or a flush
+ *	@param control The io control.
+ */
+static void apptree_null_finish(struct apptree_io_control *control)
+{
+	(void)control;
+}
+
+/** @brief Scrolls a region of the terminal
+ *	@param control The io control.
+ *	@param top The first line of the region, counted from 0 at the top.
+ *	@param height The number of lines in the region.
+ *	@param lines The number of lines to scroll the contents up by, which is
+ *	negative to scroll them down.
+ *
+ *	In diff render mode with scroll regions enabled, the region is set with a
+ *	VT100 DECSTBM sequence and scrolled by a line feed or reverse line feed per
+ *	line, and the shadow is shifted to match. The lines which remain in the
+ *	region are then left alone by the following diff, so only the lines
+ *	scrolled in and any columns which changed are written. Does nothing
+ *	otherwise, or if the whole region would be scrolled out.
+ */
+void apptree_io_scroll(struct apptree_io_control *control,
+						int top, int height, int lines)
+{
+#if APPTREE_DIFF_RENDER
+	int i, n, kept;
+	
+	if ((control->display != &apptree_terminal_display) ||
+		!control->diff_render || !control->scroll_region ||
+		!control->shadow_valid || control->goto_line || (lines == 0))
+		return;
+	
+	n = (lines < 0) ? -lines : lines;
+	if (n >= height)
+		return;
+	
+	kept = height - n;
+	apptree_print(control, "\033[%d;%dr", top + 1, top + height);
+	
+	if (lines > 0) {
+		apptree_goto(control, top + height - 1, 0);
+		for (i = 0; i < n; i++)
+			apptree_write_n(control, "\033D", 2);
+		
+		memmove(control->shadow[top], control->shadow[top + n],
+				kept * sizeof(control->shadow[0]));
+		memmove(&control->shadow_len[top], &control->shadow_len[top + n],
+				kept * sizeof(control->shadow_len[0]));
+		memset(&control->shadow_len[top + kept], 0,
+				n * sizeof(control->shadow_len[0]));
+	} else {
+		apptree_goto(control, top, 0);
+		for (i = 0; i < n; i++)
+			apptree_write_n(control, "\033M", 2);
+		
+		memmove(control->shadow[top + n], control->shadow[top],
+				kept * sizeof(control->shadow[0]));
+		memmove(&control->shadow_len[top + n], &control->shadow_len[top],
+				kept * sizeof(control->shadow_len[0]));
+		memset(&control->shadow_len[top], 0,
+				n * sizeof(control->shadow_len[0]));
+	}
+	
+	apptree_write_n(control, "\033[r", 3);
+	APPTREE_STATS_ADD(control, scrolls, 1);
+#else
+	(void)control;
+	(void)top;
+	(void)height;
+	(void)lines;
+#endif
+}
+
+#if APPTREE_DIFF_RENDER
+/** @brief Captures a char of a line into the shadow
+ *	@param control The io control.
+ *	@param c The character to be captured.
+ */
+static void apptree_capture(struct apptree_io_control *control, char c)
+{
+	if (control->line_len == TERMINAL_WIDTH)
+		return;
+	
+	if (control->shadow[control->line][control->line_len] != c) {
+		control->shadow[control->line][control->line_len] = c;
+		
+		if (control->line_first > control->line_len)
+			control->line_first = control->line_len;
+		control->line_last = control->line_len + 1;
+	}
+	
+	control->line_len++;
+}
+
+/** @brief Moves the cursor to a position on the terminal
+ *	@param control The io control.
+ *	@param line The line, counted from 0 at the top of the terminal.
+ *	@param column The column, counted from 0 at the left. It has to be 0 if a
+ *	goto_line function is binded.
+ */
+static void apptree_goto(struct apptree_io_control *control,
+							int line, int column)
+{
+	if (control->goto_line) {
+		apptree_flush(control);
+		control->goto_line(line);
+	} else {
+		apptree_print(control, "\033[%d;%dH", line + 1, column + 1);
+	}
+}
+
+/** @brief Writes the captured line if it has changed
+ *	@param control The io control.
+ *
+ *	Only the columns from the first to the last change are written, starting
+ *	from the start of the line if a goto_line function is binded. Leftovers of
+ *	a longer previous line are overwritten with spaces. When the shadow is
+ *	invalid the whole line is written and the screen is cleared with a VT100
+ *	escape sequence, or with spaces if a goto_line function is binded.
+ */
+static void apptree_write_line(struct apptree_io_control *control)
+{
+	int i;
+	int line = control->line;
+	int len = control->line_len;
+	int old_len = control->shadow_len[line];
+	int first = control->line_first;
+	int last = control->line_last;
+	
+	if (len != old_len) {
+		/* Columns past the old length may only match stale characters */
+		if (first > len)
+			first = len;
+		if (first > old_len)
+			first = old_len;
+		last = (len > old_len) ? len : old_len;
+	}
+	
+	if (!control->shadow_valid) {
+		first = 0;
+		last  = (len > old_len) ? len : old_len;
+		
+		if (control->goto_line)
+			last = TERMINAL_WIDTH;
+		else if (line == 0)
+			apptree_puts(control, "\033[2J");
+	} else if (first >= last) {
+		APPTREE_STATS_ADD(control, rows_skipped, 1);
+		return;
+	} else if (control->goto_line) {
+		first = 0;
+	}
+	
+	apptree_goto(control, line, first);
+	
+	apptree_write_n(control, &control->shadow[line][first],
+					((last < len) ? last : len) - first);
+	for (i = len; i < last; i++)
+		apptree_write_n(control, " ", 1);
+	
+	control->shadow_len[line] = len;
+	APPTREE_STATS_ADD(control, rows_drawn, 1);
+	
+	if (line == (TERMINAL_HEIGHT - 1))
+		control->shadow_valid = true;
+}
+#endif
+
 /** @brief An implementation of the C library printf function
+ *	@param control The io control.
+ *	@param format The format string, followed by its arguments.
+ *
  *	This function works like the printf function from the C standard library
  *	with a few missing features.
  *
@@ -80,11 +1011,13 @@ void apptree_puts(char *s)
  *		6. %x
  *		7. %%
  *
- *	It also supports length modifiers for %d, %o, %u and %x. All outputs of
- *	this function is redirected to the write_output function in the control
- *	struct.
+ *	It also supports field widths of any number of digits for %d, %o, %u and
+ *	%x, optionally preceded by a 0 flag to pad with zeros, as in %04x. Numbers
+ *	are converted into a buffer local to each call, so this function may be
+ *	used from more than one context. All outputs of this function are
+ *	drawn on the display binded to the given control struct.
  */
-void apptree_print(char *format, ...)
+void apptree_print(struct apptree_io_control *control, char *format, ...)
 {
 	va_list arg;
 	char *p;
@@ -93,83 +1026,71 @@ void apptree_print(char *format, ...)
 	unsigned u;
 	char *s;
 	
-	int lmod;
-	char *buff;
-	int j;
+	int width;
+	bool zero_pad;
+	char buff[APPTREE_NUMBER_SIZE];
+	int len;
 	
 	va_start(arg, format);
 	
-	p = format;
-	
 	for (p = format; *p != '\0'; p++)
 	{
 		if (*p != '%') {
-			apptree_putc(*p);
+			/* Write the run of plain chars up to the next specifier at once */
+			for (len = 1; (p[len] != '\0') && (p[len] != '%'); len++)
+				;
+			apptree_putn(control, p, len);
+			p += len - 1;
 			continue;
 		}
 		
 		p++;
 		
-		/* Find length modifiers if available */
-		if ((*p >= 49) && (*p <= 57)) {
-			lmod = *p - 48;
+		/* Find the zero flag and field width if available */
+		zero_pad = (*p == '0');
+		if (zero_pad)
 			p++;
-		} else {
-			lmod = 0;
-		}
+		
+		for (width = 0; (*p >= '0') && (*p <= '9'); p++)
+			width = (width * 10) + (*p - '0');
 		
 		switch (*p) {
 		case 'c':
 			i = va_arg(arg, int);
-			apptree_putc(i);
+			apptree_putc(control, i);
 			break;
 		case 'd':
 			i = va_arg(arg, int);
-			if (i < 0) {
-				i = -i;
-				apptree_putc('-');
-			}
-			buff = convert(i, 10);
-			if (lmod > strlen(buff)) {
-				for (j = 0; j < (lmod - strlen(buff)); j++)
-					apptree_putc(' ');
-			}
-			apptree_puts(buff);
+			u = (i < 0) ? (0u - (unsigned)i) : (unsigned)i;
+			len = convert_dec(u, buff);
+			apptree_put_number(control, buff, len, (i < 0) ? '-' : 0,
+								width, zero_pad);
 			break;
-			
 		case 'o':
-			i = va_arg(arg, unsigned int);
-			buff = convert(i, 8);
-			if (lmod > strlen(buff)) {
-				for (j = 0; j < (lmod - strlen(buff)); j++)
-					apptree_putc(' ');
-			}
-			apptree_puts(buff);
+			u = va_arg(arg, unsigned int);
+			len = convert_pow2(u, 3, buff);
+			apptree_put_number(control, buff, len, 0, width, zero_pad);
 			break;
 		case 's':
 			s = va_arg(arg, char *);
-			apptree_puts(s);
+			apptree_puts(control, s);
 			break;
 		case 'u':
 			u = va_arg(arg, unsigned int);
-			buff = convert(u, 10);
-			if (lmod > strlen(buff)) {
-				for (j = 0; j < (lmod - strlen(buff)); j++)
-					apptree_putc(' ');
-			}
-			apptree_puts(buff);
+			len = convert_dec(u, buff);
+			apptree_put_number(control, buff, len, 0, width, zero_pad);
 			break;
 		case 'x':
 			u = va_arg(arg, unsigned int);
-			buff = convert(u, 16);
-			if (lmod > strlen(buff)) {
-				for (j = 0; j < (lmod - strlen(buff)); j++)
-					apptree_putc(' ');
-			}
-			apptree_puts(buff);
+			len = convert_pow2(u, 4, buff);
+			apptree_put_number(control, buff, len, 0, width, zero_pad);
 			break;
 		case '%':
-			apptree_putc('%');
+			apptree_putc(control, '%');
+			break;
+		case '\0':
+			/* A lone % at the end of the format */
+			p--;
 			break;
 		}
 	}
@@ -177,11 +1098,108 @@ void apptree_print(char *format, ...)
 	va_end(arg);
 }
 
+#if APPTREE_INPUT_QUEUE_SIZE
+/** @brief Takes an input from the input queue
+ *	@param control The io control.
+ *	@param input The input taken.
+ *	@returns Returns 0 if an input is taken and -1 if the queue is empty.
+ *
+ *	Only the consumer side of the queue is touched, so this never contends
+ *	with apptree_io_post_input.
+ */
+static int apptree_take_input(struct apptree_io_control *control,
+								char *input)
+{
+	unsigned int head = control->input_head;
+	
+	if (head == control->input_tail)
+		return -1;
+	
+	APPTREE_MEMORY_BARRIER();
+	*input = control->input_queue[head & (APPTREE_INPUT_QUEUE_SIZE - 1)];
+	APPTREE_MEMORY_BARRIER();
+	control->input_head = head + 1;
+	
+	return 0;
+}
+#endif
+
+/** @brief Posts an input to the input queue
+ *	@param control The io control.
+ *	@param input The input to be posted.
+ *	@returns Returns 0 if the input is queued and -1 if the queue is full.
+ *
+ *	The queue has a single producer and a single consumer and needs no lock,
+ *	so this may be called from an interrupt or a task other than the one
+ *	handling the inputs, as long as only one of them posts at a time.
+ */
+int apptree_io_post_input(struct apptree_io_control *control, char input)
+{
+#if APPTREE_INPUT_QUEUE_SIZE
+	unsigned int tail = control->input_tail;
+	
+	if ((tail - control->input_head) == APPTREE_INPUT_QUEUE_SIZE)
+		return -1;
+	
+	control->input_queue[tail & (APPTREE_INPUT_QUEUE_SIZE - 1)] = input;
+	APPTREE_MEMORY_BARRIER();
+	control->input_tail = tail + 1;
+	
+	return 0;
+#else
+	(void)control;
+	(void)input;
+	return -1;
+#endif
+}
+
+/** @brief Polls the binded input
+ *	@param control The io control.
+ *	@returns Returns the number of characters held in the ring buffer.
+ *
+ *	Takes the characters posted to the input queue, then reads characters
+ *	from the read_input function in the control struct until there are no
+ *	more or the ring buffer is full.
+ */
+int apptree_io_poll(struct apptree_io_control *control)
+{
+	char input;
+	int tail;
+	
+	while (control->rx_count < APPTREE_RX_BUFFER_SIZE) {
+#if APPTREE_INPUT_QUEUE_SIZE
+		if (apptree_take_input(control, &input) &&
+			control->read_input(&input))
+			break;
+#else
+		if (control->read_input(&input))
+			break;
+#endif
+		
+		tail = (control->rx_head + control->rx_count) % APPTREE_RX_BUFFER_SIZE;
+		control->rx_buffer[tail] = input;
+		control->rx_count++;
+	}
+	
+	return control->rx_count;
+}
+
 /** @brief Reads a character from the binded input
+ *	@param control The io control.
  *	@param input The character read.
  *	@returns Returns 0 if a new character is read and -1 if otherwise.
+ *
+ *	Characters are taken from the ring buffer in the order they were read. The
+ *	binded input is polled when the ring buffer is empty.
  */
-int apptree_read(char *input)
+int apptree_read(struct apptree_io_control *control, char *input)
 {
-	return control.read_input(input);
+	if ((control->rx_count == 0) && (apptree_io_poll(control) == 0))
+		return -1;
+	
+	*input = control->rx_buffer[control->rx_head];
+	control->rx_head = (control->rx_head + 1) % APPTREE_RX_BUFFER_SIZE;
+	control->rx_count--;
+	
+	return 0;
 }
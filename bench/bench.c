@@ -0,0 +1,567 @@
+
+/** @file bench.c
+ *  @brief Benchmarks for navigating and rendering the apptree
+ *  @author Dennis Law
+ *  @date October 2026
+ *
+ *	Builds synthetic trees, feeds scripted key sequences through read_input
+ *	and counts what each scenario costs. Every scenario is deterministic, so
+ *	the byte, write and row counts can be compared across changes as they
+ *	are, while the times depend on the machine.
+ *
+ *	The columns are:
+ *		keys	Keys fed through read_input.
+ *		menus	Menus printed, in full or in part.
+ *		bytes	Characters handed to the output.
+ *		writes	Calls to write_output.
+ *		rows	Rows drawn, each of which looks up one child of the index.
+ *		time	Time spent in apptree_handle_input and apptree_tick per key.
+ *
+ *	Times are in nanoseconds on the host. When built for a core with a DWT
+ *	cycle counter, or with APPTREE_CYCLES_READ defined, they are counted in
+ *	cycles through apptree_cycles.h instead.
+ *
+ *	@note The apptree has to be compiled with APPTREE_STATS and
+ *	APPTREE_DIFF_RENDER set to 1, as the Makefile does.
+ */
+
+#define _POSIX_C_SOURCE					199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "apptree.h"
+#include "apptree_cycles.h"
+
+#if !APPTREE_CYCLES_DWT && !defined(APPTREE_CYCLES_READ)
+#include <time.h>
+#endif
+
+#if !APPTREE_STATS || !APPTREE_DIFF_RENDER
+#error "bench.c needs APPTREE_STATS and APPTREE_DIFF_RENDER set to 1"
+#endif
+
+/** Number of children of the wide tree */
+#define BENCH_WIDE_ITEMS				1000
+/** Depth of the deep tree */
+#define BENCH_DEEP_LEVELS				64
+/** Number of children of every level of the deep tree */
+#define BENCH_DEEP_ITEMS				4
+/** Number of nodes attached by the subtree scenario */
+#define BENCH_SUBTREE_NODES				2000
+/** Number of times each navigation script is replayed */
+#define BENCH_REPEATS					20
+
+/** Ways in which the menu is written */
+enum bench_render {
+	BENCH_RENDER_FULL,
+	BENCH_RENDER_DIFF,
+	BENCH_RENDER_SCROLL
+};
+
+/** Names of the ways in which the menu is written */
+static const char *const bench_render_names[] = { "full", "diff", "scroll" };
+
+/** Key sequence replayed by the frame limit scenario */
+static const char bench_sequence[] =
+	"sdsdsdaswwssdssddsdawwdsssssssssssssssssssssssssdhss";
+
+static struct apptree_keybindings bench_keys = {
+	'w', 's', 'd', 'a', 'h', '[', ']'
+};
+
+static struct apptree_control bench_control;
+
+/** Keys left to be read */
+static const char *bench_input;
+/** Number of keys read_input may still hand out before the next poll */
+static int bench_gate;
+/** Number of calls to write_output */
+static unsigned long bench_writes;
+
+static int bench_read(char *input);
+static void bench_write(char output);
+static void bench_function(struct apptree_node *parent, int child_idx);
+static uint64_t bench_now(void);
+static const char *bench_unit(void);
+static char *bench_title(const char *prefix, int i);
+static void bench_init(struct apptree_node **master,
+						enum bench_render render);
+static void bench_build_wide(struct apptree_node *master);
+static void bench_build_deep(struct apptree_node *master);
+static void bench_build_mixed(struct apptree_node *master);
+static char *bench_script(const char *part, int count, char *script);
+static uint64_t bench_feed(const char *keys, int interval, int *ticks);
+static void bench_print_row(const char *name, const char *render, int keys,
+							uint64_t time);
+static void bench_navigation(void);
+static void bench_scroll(void);
+static void bench_frame_limit(void);
+static void bench_subtree(void);
+
+
+/* -------------------------------------------------------------------------- */
+/** @name Callback Functions
+ */
+/** @{*/
+
+/** @brief Reads the next scripted key
+ *	@param input Handle for holding the key.
+ *	@returns 0 if a key is read and -1 if otherwise.
+ *
+ *	Only one key is handed out per poll, as if each key was pressed on its
+ *	own, so that every key costs a menu.
+ */
+static int bench_read(char *input)
+{
+	if ((*bench_input == '\0') || (bench_gate == 0))
+		return -1;
+	
+	bench_gate--;
+	*input = *bench_input++;
+	return 0;
+}
+
+/** @brief Counts a written character
+ *	@param output The character, which is dropped.
+ */
+static void bench_write(char output)
+{
+	(void)output;
+	bench_writes++;
+}
+
+/** @brief Function bound to the synthetic nodes
+ *	@param parent Parent of the selected node.
+ *	@param child_idx Position of the selected node.
+ */
+static void bench_function(struct apptree_node *parent, int child_idx)
+{
+	(void)parent;
+	(void)child_idx;
+}
+
+/** @}*/
+
+
+/* -------------------------------------------------------------------------- */
+/** @name Timing Functions
+ */
+/** @{*/
+
+/** @brief Reads the time
+ *	@returns The time in nanoseconds, or in cycles on the target.
+ */
+static uint64_t bench_now(void)
+{
+#if APPTREE_CYCLES_DWT || defined(APPTREE_CYCLES_READ)
+	return apptree_cycles_read();
+#else
+	struct timespec now;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#endif
+}
+
+/** @brief Gets the unit of the times
+ *	@returns The name of the unit.
+ */
+static const char *bench_unit(void)
+{
+#if APPTREE_CYCLES_DWT || defined(APPTREE_CYCLES_READ)
+	return "cycles";
+#else
+	return "ns";
+#endif
+}
+
+/** @}*/
+
+
+/* -------------------------------------------------------------------------- */
+/** @name Tree Functions
+ *	Builds the synthetic trees. Titles are allocated once per node and kept
+ *	for as long as the process runs.
+ */
+/** @{*/
+
+/** @brief Formats a numbered title
+ *	@param prefix Start of the title.
+ *	@param i The number.
+ *	@returns The title.
+ */
+static char *bench_title(const char *prefix, int i)
+{
+	char *title = malloc(strlen(prefix) + 12);
+	
+	if (title == NULL) {
+		fprintf(stderr, "bench: out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	sprintf(title, "%s %d", prefix, i);
+	return title;
+}
+
+/** @brief Starts a new session for a scenario
+ *	@param master Handle for holding the master node.
+ *	@param render The way in which the menu is written.
+ *
+ *	The tree of the previous scenario is dropped, as the apptree keeps no
+ *	way of freeing it.
+ */
+static void bench_init(struct apptree_node **master, enum bench_render render)
+{
+	memset(&bench_control, 0, sizeof(bench_control));
+	bench_input = "";
+	bench_gate	= 0;
+	
+	if (apptree_init(&bench_control, master, "Main", APPTREE_MODE_SIMPLE,
+						&bench_keys, bench_read, bench_write)) {
+		fprintf(stderr, "bench: apptree_init failed\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	if (render != BENCH_RENDER_FULL)
+		apptree_set_diff_render(&bench_control, true, NULL);
+	if (render == BENCH_RENDER_SCROLL)
+		apptree_set_scroll_region(&bench_control, true);
+}
+
+/** @brief Builds a single list of BENCH_WIDE_ITEMS items
+ *	@param master The master node.
+ */
+static void bench_build_wide(struct apptree_node *master)
+{
+	struct apptree_node *list, *node;
+	int i;
+	
+	apptree_create_node(&bench_control, &list, master, "List", "wide list",
+						APPTREE_MODE_SIMPLE, false, NULL);
+	
+	for (i = 0; i < BENCH_WIDE_ITEMS; i++)
+		apptree_create_node(&bench_control, &node, list,
+							bench_title("item", i), "item",
+							APPTREE_MODE_SIMPLE, false, bench_function);
+}
+
+/** @brief Builds BENCH_DEEP_LEVELS levels, each leading on through its
+ *	first child
+ *	@param master The master node.
+ */
+static void bench_build_deep(struct apptree_node *master)
+{
+	struct apptree_node *level = master;
+	struct apptree_node *next = NULL;
+	struct apptree_node *node;
+	int depth, i;
+	
+	for (depth = 0; depth < BENCH_DEEP_LEVELS; depth++) {
+		for (i = 0; i < BENCH_DEEP_ITEMS; i++) {
+			apptree_create_node(&bench_control, &node, level,
+								bench_title("level", depth), "level",
+								APPTREE_MODE_SIMPLE, false,
+								i ? bench_function : NULL);
+			if (i == 0)
+				next = node;
+		}
+	
+		level = next;
+	}
+}
+
+/** @brief Builds a Single Selection, a Multi Selection and a long Simple
+ *	list
+ *	@param master The master node.
+ */
+static void bench_build_mixed(struct apptree_node *master)
+{
+	struct apptree_node *list, *node;
+	int i;
+	
+	apptree_create_node(&bench_control, &list, master, "Single",
+						"single info", APPTREE_MODE_SINGLE_SELECTION, false,
+						NULL);
+	for (i = 0; i < 5; i++)
+		apptree_create_node(&bench_control, &node, list,
+							bench_title("opt", i), "o",
+							APPTREE_MODE_SIMPLE, i == 0, bench_function);
+	
+	apptree_create_node(&bench_control, &list, master, "Multi",
+						"multi info", APPTREE_MODE_MULTI_SELECTION, false,
+						NULL);
+	for (i = 0; i < 25; i++)
+		apptree_create_node(&bench_control, &node, list,
+							bench_title("m", i), "o",
+							APPTREE_MODE_SIMPLE, false, bench_function);
+	
+	apptree_create_node(&bench_control, &list, master, "Wide", "wide info",
+						APPTREE_MODE_SIMPLE, false, NULL);
+	for (i = 0; i < 300; i++)
+		apptree_create_node(&bench_control, &node, list,
+							bench_title("item", i), "w",
+							APPTREE_MODE_SIMPLE, false, bench_function);
+}
+
+/** @}*/
+
+
+/* -------------------------------------------------------------------------- */
+/** @name Scenario Functions
+ */
+/** @{*/
+
+/** @brief Appends a part of a script a number of times
+ *	@param part The keys to be appended.
+ *	@param count Number of times the keys are appended.
+ *	@param script End of the script.
+ *	@returns The new end of the script.
+ */
+static char *bench_script(const char *part, int count, char *script)
+{
+	size_t len = strlen(part);
+	
+	while (count-- > 0) {
+		memcpy(script, part, len);
+		script += len;
+	}
+	
+	*script = '\0';
+	return script;
+}
+
+/** @brief Feeds keys to the session one poll at a time
+ *	@param keys The keys.
+ *	@param interval Frame limit of the session, or 0 for none.
+ *	@param ticks Handle for adding up the menus printed by apptree_tick, or
+ *	NULL.
+ *	@returns The time spent handling the keys.
+ *
+ *	With a frame limit, apptree_tick is called once per poll, and a few more
+ *	times once the keys run out so that the last menu is printed.
+ */
+static uint64_t bench_feed(const char *keys, int interval, int *ticks)
+{
+	uint64_t start, time = 0;
+	int i;
+	
+	bench_input = keys;
+	while (*bench_input) {
+		bench_gate = 1;
+		start = bench_now();
+		apptree_handle_input(&bench_control);
+		if (interval > 0)
+			*ticks += apptree_tick(&bench_control);
+		time += bench_now() - start;
+	}
+	
+	for (i = 0; (interval > 0) && (i < interval); i++)
+		*ticks += apptree_tick(&bench_control);
+	
+	return time;
+}
+
+/** @brief Prints the counters of the session as a row of the table
+ *	@param name Name of the scenario.
+ *	@param render Name of the way in which the menu is written.
+ *	@param keys Number of keys fed.
+ *	@param time Time spent handling the keys.
+ */
+static void bench_print_row(const char *name, const char *render, int keys,
+							uint64_t time)
+{
+	struct apptree_stats stats;
+	
+	apptree_get_stats(&bench_control, &stats);
+	printf("%-10s %-7s %7d %7lu %9lu %9lu %8lu %9lu\n", name, render, keys,
+			(unsigned long)(stats.full_redraws + stats.partial_redraws),
+			(unsigned long)stats.bytes, bench_writes,
+			(unsigned long)stats.rows_drawn,
+			keys ? (unsigned long)(time / (uint64_t)keys) : 0ul);
+}
+
+/** @brief Navigates the wide, deep and mixed trees
+ *
+ *	Each script ends at the master node, so it is replayed BENCH_REPEATS
+ *	times on the same session. The counters cover every replay.
+ */
+static void bench_navigation(void)
+{
+	static char script[4096];
+	static const char *const names[] = { "wide", "deep", "mixed" };
+	struct apptree_node *master;
+	uint64_t time;
+	int shape, render, i;
+	
+	printf("%-10s %-7s %7s %7s %9s %9s %8s %9s\n", "tree", "render",
+			"keys", "menus", "bytes", "writes", "rows", bench_unit());
+	
+	for (shape = 0; shape < 3; shape++) {
+		if (shape == 0) {
+			bench_script("ss", 100, bench_script("d", 1, script));
+			bench_script("w", 50, bench_script("]", 10,
+							script + strlen(script)));
+			bench_script("h", 1, script + strlen(script));
+		} else if (shape == 1) {
+			bench_script("s", 1, bench_script("d", BENCH_DEEP_LEVELS, script));
+			bench_script("a", BENCH_DEEP_LEVELS - 1, script + strlen(script));
+			bench_script("h", 1, script + strlen(script));
+		} else {
+			strcpy(script, "dsdsdswsdawsdsssdsdsdsdaw"
+							"sd[s]s]s]wwwwwwwwwwdddddah");
+		}
+	
+		for (render = BENCH_RENDER_FULL; render <= BENCH_RENDER_SCROLL;
+				render++) {
+			bench_init(&master, (enum bench_render)render);
+			if (shape == 0)
+				bench_build_wide(master);
+			else if (shape == 1)
+				bench_build_deep(master);
+			else
+				bench_build_mixed(master);
+	
+			apptree_enable(&bench_control);
+			apptree_reset_stats(&bench_control);
+			bench_writes = 0;
+	
+			time = 0;
+			for (i = 0; i < BENCH_REPEATS; i++)
+				time += bench_feed(script, 0, NULL);
+	
+			bench_print_row(names[shape], bench_render_names[render],
+							(int)strlen(script) * BENCH_REPEATS, time);
+		}
+	}
+}
+
+/** @brief Scrolls the frame of a 300 item list by a single row
+ *
+ *	The arrow is first moved to the last row of the frame, so that the next
+ *	key scrolls the frame. Only that key is counted.
+ */
+static void bench_scroll(void)
+{
+	static char script[FRAME_HEIGHT + 2];
+	struct apptree_node *master;
+	uint64_t time;
+	int render;
+	
+	printf("\n%-10s %-7s %7s %7s %9s %9s %8s %9s\n", "scroll", "render",
+			"keys", "menus", "bytes", "writes", "rows", bench_unit());
+	
+	bench_script("s", FRAME_HEIGHT - 1, bench_script("ssd", 1, script));
+	
+	for (render = BENCH_RENDER_FULL; render <= BENCH_RENDER_SCROLL;
+			render++) {
+		bench_init(&master, (enum bench_render)render);
+		bench_build_mixed(master);
+		apptree_enable(&bench_control);
+		bench_feed(script, 0, NULL);
+	
+		apptree_reset_stats(&bench_control);
+		bench_writes = 0;
+		time = bench_feed("s", 0, NULL);
+		bench_print_row("row step", bench_render_names[render], 1, time);
+	}
+}
+
+/** @brief Replays a key sequence one key per tick under a frame limit
+ *
+ *	The menu is written in diff render mode. An interval of 0 prints a menu
+ *	for every key. The counters include the first menu, printed by
+ *	apptree_enable.
+ */
+static void bench_frame_limit(void)
+{
+	static const int intervals[] = { 0, 1, 2, 3, 5 };
+	struct apptree_node *master;
+	char name[16];
+	uint64_t time;
+	int i, ticks;
+	
+	printf("\n%-10s %-7s %7s %7s %9s %9s %8s %9s\n", "interval", "render",
+			"keys", "menus", "bytes", "writes", "rows", bench_unit());
+	
+	for (i = 0; i < (int)(sizeof(intervals) / sizeof(intervals[0])); i++) {
+		bench_init(&master, BENCH_RENDER_DIFF);
+		bench_build_mixed(master);
+		apptree_set_frame_limit(&bench_control, intervals[i]);
+		bench_writes = 0;
+		apptree_enable(&bench_control);
+	
+		ticks = 0;
+		time = bench_feed(bench_sequence, intervals[i], &ticks);
+	
+		sprintf(name, "%d", intervals[i]);
+		bench_print_row(name, "diff", (int)strlen(bench_sequence), time);
+	}
+}
+
+/** @brief Attaches a table of BENCH_SUBTREE_NODES nodes and enables the tree
+ *
+ *	The table is laid out as lists of 50 items under groups of the master.
+ */
+static void bench_subtree(void)
+{
+	static struct apptree_node_spec spec[BENCH_SUBTREE_NODES];
+	static struct apptree_node *nodes[BENCH_SUBTREE_NODES];
+	struct apptree_node *master;
+	uint64_t start, attach, enable;
+	int i, group = -1;
+	
+	for (i = 0; i < BENCH_SUBTREE_NODES; i++) {
+		if ((i % 51) == 0) {
+			group = i;
+			spec[i].parent	 = -1;
+			spec[i].title	 = bench_title("group", i / 51);
+			spec[i].function = NULL;
+		} else {
+			spec[i].parent	 = group;
+			spec[i].title	 = bench_title("node", i);
+			spec[i].function = bench_function;
+		}
+	
+		spec[i].info	 = "node";
+		spec[i].mode	 = APPTREE_MODE_SIMPLE;
+		spec[i].selected = false;
+	}
+	
+	bench_init(&master, BENCH_RENDER_FULL);
+	
+	start = bench_now();
+	if (apptree_create_subtree(&bench_control, nodes, master, spec,
+								BENCH_SUBTREE_NODES)) {
+		fprintf(stderr, "bench: apptree_create_subtree failed\n");
+		exit(EXIT_FAILURE);
+	}
+	attach = bench_now() - start;
+	
+	start = bench_now();
+	apptree_enable(&bench_control);
+	enable = bench_now() - start;
+	
+	printf("\nsubtree    %d nodes attached in %lu %s, enabled in %lu %s\n",
+			BENCH_SUBTREE_NODES, (unsigned long)attach, bench_unit(),
+			(unsigned long)enable, bench_unit());
+}
+
+/** @}*/
+
+
+int main(void)
+{
+	apptree_cycles_start();
+	
+	printf("sizeof(struct apptree_node) = %u bytes%s\n\n",
+			(unsigned)sizeof(struct apptree_node),
+			APPTREE_COMPACT_NODES ? " (compact)" : "");
+	
+	bench_navigation();
+	bench_scroll();
+	bench_frame_limit();
+	bench_subtree();
+	
+	return 0;
+}
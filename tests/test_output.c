@@ -0,0 +1,135 @@
+
+/** @file test_output.c
+ *  @brief Tests for writing more deferred output than the tx buffer holds
+ *  @author Dennis Law
+ *  @date October 2026
+ *
+ *	Output is deferred and written in runs longer than APPTREE_TX_BUFFER_SIZE,
+ *	with part of the buffer drained in between. Every character has to reach
+ *	the output function once and in order.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "apptree_io.h"
+
+/** Checks a condition, counting and reporting it if it does not hold */
+#define TEST_CHECK(condition)										\
+	do {															\
+		if (!(condition)) {											\
+			printf("%s:%d: %s\n", __FILE__, __LINE__, #condition);	\
+			test_failures++;										\
+		}															\
+	} while (0)
+
+/** Number of characters written in each run */
+#define TEST_RUN_SIZE		(3 * APPTREE_TX_BUFFER_SIZE + 5)
+
+static struct apptree_io_control test_control;
+
+/** Characters written, in order */
+static char test_output[4 * TEST_RUN_SIZE];
+/** Number of characters written */
+static size_t test_bytes;
+/** Number of checks which did not hold */
+static int test_failures;
+
+static int test_read(char *input);
+static void test_write(char output);
+static void test_fill(char *run, char first);
+static void test_overflow_deferred(void);
+
+
+/* -------------------------------------------------------------------------- */
+/** @name Callback Functions
+ */
+/** @{*/
+
+/** @brief Reads no key
+ *	@param input Handle for holding the key.
+ *	@returns -1, as there are no keys.
+ */
+static int test_read(char *input)
+{
+	(void)input;
+	return -1;
+}
+
+/** @brief Records a written character
+ *	@param output The character.
+ */
+static void test_write(char output)
+{
+	if (test_bytes < sizeof(test_output))
+		test_output[test_bytes] = output;
+	test_bytes++;
+}
+
+/** @}*/
+
+
+/* -------------------------------------------------------------------------- */
+/** @name Test Functions
+ */
+/** @{*/
+
+/** @brief Fills a run with characters counting up from a letter
+ *	@param run The run, of TEST_RUN_SIZE characters.
+ *	@param first The first letter.
+ */
+static void test_fill(char *run, char first)
+{
+	int i;
+	
+	for (i = 0; i < TEST_RUN_SIZE; i++)
+		run[i] = (char)(first + i % 26);
+}
+
+/** @brief Writes two runs which overflow the tx buffer while deferred
+ */
+static void test_overflow_deferred(void)
+{
+	static char runs[2][TEST_RUN_SIZE];
+	
+	test_fill(runs[0], 'a');
+	test_fill(runs[1], 'A');
+	
+	apptree_io_init(&test_control, test_read, test_write);
+	apptree_io_set_deferred(&test_control, true);
+	
+	/* Part of the first run is drained, leaving room at the front */
+	apptree_putn(&test_control, runs[0], APPTREE_TX_BUFFER_SIZE);
+	TEST_CHECK(test_bytes == 0);
+	TEST_CHECK(apptree_io_drain(&test_control, 10) == 10);
+	
+	apptree_putn(&test_control, &runs[0][APPTREE_TX_BUFFER_SIZE],
+					TEST_RUN_SIZE - APPTREE_TX_BUFFER_SIZE);
+	apptree_putn(&test_control, runs[1], TEST_RUN_SIZE);
+	
+	while (apptree_io_pending(&test_control))
+		apptree_io_drain(&test_control, 7);
+	
+	TEST_CHECK(test_bytes == 2 * TEST_RUN_SIZE);
+	TEST_CHECK(memcmp(test_output, runs[0], TEST_RUN_SIZE) == 0);
+	TEST_CHECK(memcmp(&test_output[TEST_RUN_SIZE], runs[1],
+						TEST_RUN_SIZE) == 0);
+#if APPTREE_STATS
+	TEST_CHECK(test_control.stats.overflows > 0);
+	TEST_CHECK(test_control.stats.bytes == 2 * TEST_RUN_SIZE);
+#endif
+}
+
+/** @}*/
+
+
+int main(void)
+{
+	test_overflow_deferred();
+	
+	if (test_failures)
+		printf("test_output: %d checks failed\n", test_failures);
+	else
+		printf("test_output: passed\n");
+	
+	return test_failures ? 1 : 0;
+}
@@ -0,0 +1,198 @@
+
+/** @file test_subtree.c
+ *  @brief Tests for creating subtrees which do not fit into the tree
+ *  @author Dennis Law
+ *  @date October 2026
+ *
+ *	Each test fills a node up to APPTREE_MAX_CHILDREN children and then
+ *	creates a subtree which runs out of children halfway through. None of
+ *	the subtree must be left attached, and the tree must still be enabled
+ *	and shown afterwards.
+ *
+ *	@note The apptree has to be compiled with APPTREE_COMPACT_NODES set, as
+ *	the Makefile does, which keeps APPTREE_MAX_CHILDREN small enough to reach.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "apptree.h"
+
+#if !APPTREE_COMPACT_NODES
+#error "test_subtree.c needs APPTREE_COMPACT_NODES set"
+#endif
+
+/** Checks a condition, counting and reporting it if it does not hold */
+#define TEST_CHECK(condition)										\
+	do {															\
+		if (!(condition)) {											\
+			printf("%s:%d: %s\n", __FILE__, __LINE__, #condition);	\
+			test_failures++;										\
+		}															\
+	} while (0)
+
+/** Number of children the master is filled with before the subtree */
+#define TEST_FILL		(APPTREE_MAX_CHILDREN - 1)
+
+static struct apptree_keybindings test_keys = {
+	'w', 's', 'd', 'a', 'h', '[', ']'
+};
+
+static struct apptree_control test_control;
+
+/** Number of checks which did not hold */
+static int test_failures;
+
+/** Entries filling the master */
+static struct apptree_node_spec test_fill[TEST_FILL];
+/** Handles of the entries filling the master */
+static struct apptree_node *test_fill_nodes[TEST_FILL];
+
+/** A subtree of which the third entry is one child too many for the master */
+static const struct apptree_node_spec test_overflow[] = {
+	{ -1, "Group", "group", APPTREE_MODE_SIMPLE, false, NULL },
+	{ 0, "Inner", "inner", APPTREE_MODE_SIMPLE, false, NULL },
+	{ -1, "Extra", "extra", APPTREE_MODE_SIMPLE, false, NULL }
+};
+
+APPTREE_POOL(test_pool, TEST_FILL + 8);
+
+static int test_read(char *input);
+static void test_write(char output);
+static void test_init_fill(void);
+static void test_check_master(struct apptree_node *master,
+								struct apptree_node *last_child);
+static void test_overflow_heap(void);
+static void test_overflow_pool(void);
+
+
+/* -------------------------------------------------------------------------- */
+/** @name Callback Functions
+ */
+/** @{*/
+
+/** @brief Reads no key
+ *	@param input Handle for holding the key.
+ *	@returns -1, as there are no keys.
+ */
+static int test_read(char *input)
+{
+	(void)input;
+	return -1;
+}
+
+/** @brief Drops a written character
+ *	@param output The character.
+ */
+static void test_write(char output)
+{
+	(void)output;
+}
+
+/** @}*/
+
+
+/* -------------------------------------------------------------------------- */
+/** @name Test Functions
+ */
+/** @{*/
+
+/** @brief Fills in the entries filling the master
+ */
+static void test_init_fill(void)
+{
+	int i;
+	
+	for (i = 0; i < TEST_FILL; i++) {
+		test_fill[i].parent	  = -1;
+		test_fill[i].title	  = "Leaf";
+		test_fill[i].info	  = "leaf";
+		test_fill[i].mode	  = APPTREE_MODE_SIMPLE;
+		test_fill[i].selected = false;
+		test_fill[i].function = NULL;
+	}
+}
+
+/** @brief Checks that the master holds only the nodes filling it
+ *	@param master The master node.
+ *	@param last_child The last node filling the master.
+ */
+static void test_check_master(struct apptree_node *master,
+								struct apptree_node *last_child)
+{
+	TEST_CHECK(master->num_child == TEST_FILL);
+	TEST_CHECK(master->last_child == last_child);
+	TEST_CHECK(test_control.tree->num_nodes == TEST_FILL + 1);
+	
+	TEST_CHECK(apptree_enable(&test_control) == 0);
+	TEST_CHECK(master->children[TEST_FILL - 1] == last_child);
+	TEST_CHECK(test_control.picture_height == TEST_FILL);
+}
+
+/** @brief Overflows the master of a tree on the heap
+ */
+static void test_overflow_heap(void)
+{
+	struct apptree_node *nodes[3];
+	struct apptree_node *master;
+	
+	memset(&test_control, 0, sizeof(test_control));
+	
+	TEST_CHECK(apptree_init(&test_control, &master, "Main",
+							APPTREE_MODE_SIMPLE, &test_keys, test_read,
+							test_write) == 0);
+	TEST_CHECK(apptree_create_subtree(&test_control, test_fill_nodes, master,
+										test_fill, TEST_FILL) == 0);
+	
+	TEST_CHECK(apptree_create_subtree(&test_control, nodes, master,
+										test_overflow, 3) == -1);
+	test_check_master(master, test_fill_nodes[TEST_FILL - 1]);
+}
+
+/** @brief Overflows the master of a tree in a pool
+ */
+static void test_overflow_pool(void)
+{
+	struct apptree_node *master;
+	struct apptree_node *node;
+	int used;
+	
+	memset(&test_control, 0, sizeof(test_control));
+	
+	TEST_CHECK(apptree_init_pool(&test_control, &master, "Main",
+									APPTREE_MODE_SIMPLE, &test_keys,
+									test_read, test_write, &test_pool) == 0);
+	TEST_CHECK(apptree_create_subtree(&test_control, NULL, master,
+										test_fill, TEST_FILL) == 0);
+	
+	used = test_pool.used;
+	TEST_CHECK(apptree_create_subtree(&test_control, NULL, master,
+										test_overflow, 3) == -1);
+	TEST_CHECK(test_pool.used == used);
+	test_check_master(master, &test_pool.nodes[used - 1]);
+	
+	/* The nodes taken back are handed out again */
+	TEST_CHECK(apptree_begin_update(&test_control) == 0);
+	TEST_CHECK(apptree_create_node(&test_control, &node, master, "Last",
+									"last", APPTREE_MODE_SIMPLE, false,
+									NULL) == 0);
+	TEST_CHECK(node == &test_pool.nodes[used]);
+	TEST_CHECK(apptree_commit_update(&test_control) == 0);
+	TEST_CHECK(master->num_child == APPTREE_MAX_CHILDREN);
+}
+
+/** @}*/
+
+
+int main(void)
+{
+	test_init_fill();
+	test_overflow_heap();
+	test_overflow_pool();
+	
+	if (test_failures)
+		printf("test_subtree: %d checks failed\n", test_failures);
+	else
+		printf("test_subtree: passed\n");
+	
+	return test_failures ? 1 : 0;
+}
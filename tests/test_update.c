@@ -0,0 +1,231 @@
+
+/** @file test_update.c
+ *  @brief Tests for changing the structure of a tree while it is shown
+ *  @author Dennis Law
+ *  @date October 2026
+ *
+ *	Each test builds a small tree, shows one of its nodes and changes the
+ *	tree within an update. The Makefile builds the tests with the address
+ *	and undefined behavior sanitizers, so that a node which is read after
+ *	it has been freed, or a child index which is read past its end, fails
+ *	the test even where the output would look right.
+ *
+ *	@note The apptree has to be compiled with APPTREE_MESSAGE_QUEUE_SIZE set,
+ *	as the Makefile does.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "apptree.h"
+
+#if !APPTREE_MESSAGE_QUEUE_SIZE
+#error "test_update.c needs APPTREE_MESSAGE_QUEUE_SIZE set"
+#endif
+
+/** Checks a condition, counting and reporting it if it does not hold */
+#define TEST_CHECK(condition)										\
+	do {															\
+		if (!(condition)) {											\
+			printf("%s:%d: %s\n", __FILE__, __LINE__, #condition);	\
+			test_failures++;										\
+		}															\
+	} while (0)
+
+static struct apptree_keybindings test_keys = {
+	'w', 's', 'd', 'a', 'h', '[', ']'
+};
+
+static struct apptree_control test_control;
+
+/** Keys left to be read */
+static const char *test_input;
+/** Number of characters written */
+static unsigned long test_bytes;
+/** Number of checks which did not hold */
+static int test_failures;
+
+static int test_read(char *input);
+static void test_write(char output);
+static void test_function(struct apptree_node *parent, int child_idx);
+static void test_feed(const char *keys);
+static void test_remove_shown_children(void);
+static void test_remove_posted_nodes(void);
+
+
+/* -------------------------------------------------------------------------- */
+/** @name Callback Functions
+ */
+/** @{*/
+
+/** @brief Reads the next scripted key
+ *	@param input Handle for holding the key.
+ *	@returns 0 if a key is read and -1 if otherwise.
+ */
+static int test_read(char *input)
+{
+	if (*test_input == '\0')
+		return -1;
+	
+	*input = *test_input++;
+	return 0;
+}
+
+/** @brief Counts a written character
+ *	@param output The character, which is dropped.
+ */
+static void test_write(char output)
+{
+	(void)output;
+	test_bytes++;
+}
+
+/** @brief Function bound to the leaves
+ *	@param parent Parent of the selected node.
+ *	@param child_idx Position of the selected node.
+ */
+static void test_function(struct apptree_node *parent, int child_idx)
+{
+	(void)parent;
+	(void)child_idx;
+}
+
+/** @brief Feeds keys to the session
+ *	@param keys The keys.
+ */
+static void test_feed(const char *keys)
+{
+	test_input = keys;
+	while (*test_input)
+		apptree_handle_input(&test_control);
+}
+
+/** @}*/
+
+
+/* -------------------------------------------------------------------------- */
+/** @name Test Functions
+ */
+/** @{*/
+
+/** @brief Removes every child of the shown node and commits the update
+ *
+ *	The shown node is left with no children, so the menu printed by the
+ *	commit, and every key handled after it, must not look up a child.
+ */
+static void test_remove_shown_children(void)
+{
+	struct apptree_node *master, *group, *node;
+	struct apptree_node *leaves[30];
+	int i;
+	
+	memset(&test_control, 0, sizeof(test_control));
+	test_input = "";
+	
+	TEST_CHECK(apptree_init(&test_control, &master, "Main",
+							APPTREE_MODE_SIMPLE, &test_keys, test_read,
+							test_write) == 0);
+	apptree_create_node(&test_control, &node, master, "Other", "other",
+						APPTREE_MODE_SIMPLE, false, test_function);
+	apptree_create_node(&test_control, &group, master, "Group", "group",
+						APPTREE_MODE_SIMPLE, false, NULL);
+	for (i = 0; i < 30; i++)
+		apptree_create_node(&test_control, &leaves[i], group, "Leaf", "leaf",
+							APPTREE_MODE_SIMPLE, false, test_function);
+	
+	TEST_CHECK(apptree_enable(&test_control) == 0);
+	
+	/* Open the group and move the arrow, and the frame, near its end */
+	test_feed("sd");
+	test_feed("wwww");
+	TEST_CHECK(test_control.current == group);
+	TEST_CHECK(test_control.frame_pos > 0);
+	
+	TEST_CHECK(apptree_begin_update(&test_control) == 0);
+	for (i = 0; i < 30; i++)
+		TEST_CHECK(apptree_remove_node(&test_control, leaves[i]) == 0);
+	
+	test_bytes = 0;
+	TEST_CHECK(apptree_commit_update(&test_control) == 0);
+	TEST_CHECK(test_bytes > 0);
+	TEST_CHECK(test_control.current == group);
+	TEST_CHECK(test_control.picture_height == 0);
+	TEST_CHECK(test_control.select_pos == 0);
+	TEST_CHECK(test_control.frame_pos == 0);
+	
+	test_feed("swd[]");
+	TEST_CHECK(test_control.current == group);
+	
+	test_feed("a");
+	TEST_CHECK(test_control.current == master);
+	TEST_CHECK(test_control.picture_height == 2);
+}
+
+/** @brief Removes nodes which messages have been posted to and commits the
+ *	update
+ *
+ *	The messages are still queued when the nodes are freed by the commit, so
+ *	they must be dropped rather than applied. A message to a node which is
+ *	kept is still applied.
+ */
+static void test_remove_posted_nodes(void)
+{
+	struct apptree_node *master, *group, *kept, *leaf;
+	struct apptree_message message;
+	
+	memset(&test_control, 0, sizeof(test_control));
+	test_input = "";
+	
+	apptree_init(&test_control, &master, "Main", APPTREE_MODE_SIMPLE,
+					&test_keys, test_read, test_write);
+	apptree_create_node(&test_control, &kept, master, "Kept", "kept",
+						APPTREE_MODE_SIMPLE, false, test_function);
+	apptree_create_node(&test_control, &group, master, "Group", "group",
+						APPTREE_MODE_SIMPLE, false, NULL);
+	apptree_create_node(&test_control, &leaf, group, "Leaf", "leaf",
+						APPTREE_MODE_SIMPLE, false, test_function);
+	apptree_enable(&test_control);
+	
+	message.type	   = APPTREE_MESSAGE_TITLE;
+	message.node	   = leaf;
+	message.value.text = "Renamed leaf";
+	TEST_CHECK(apptree_post_message(&test_control, &message) == 0);
+	message.node	   = group;
+	message.value.text = "Renamed group";
+	TEST_CHECK(apptree_post_message(&test_control, &message) == 0);
+	message.node	   = kept;
+	message.value.text = "Renamed";
+	TEST_CHECK(apptree_post_message(&test_control, &message) == 0);
+	
+	TEST_CHECK(apptree_begin_update(&test_control) == 0);
+	TEST_CHECK(apptree_remove_node(&test_control, group) == 0);
+	
+	/* Removed nodes are refused until they are freed by the commit */
+	message.node	   = leaf;
+	message.value.text = "Too late";
+	TEST_CHECK(apptree_post_message(&test_control, &message) == -1);
+	TEST_CHECK(apptree_update_node(&test_control, &message) == -1);
+	
+	TEST_CHECK(apptree_commit_update(&test_control) == 0);
+	TEST_CHECK(master->num_child == 1);
+	
+	/* A poll with no keys still applies the messages */
+	apptree_handle_input(&test_control);
+	TEST_CHECK(strcmp(kept->title, "Renamed") == 0);
+	TEST_CHECK(test_control.message_head == test_control.message_tail);
+}
+
+/** @}*/
+
+
+int main(void)
+{
+	test_remove_shown_children();
+	test_remove_posted_nodes();
+	
+	if (test_failures)
+		printf("test_update: %d checks failed\n", test_failures);
+	else
+		printf("test_update: passed\n");
+	
+	return test_failures ? 1 : 0;
+}